@@ -18,46 +18,326 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 #pragma once
 
 #include "modo.hh"
+#include "thread.hh"
 #include <alsa/asoundlib.h>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
 
 namespace modo {
 
 class ALSAOutput {
-	static void play_buffer(snd_pcm_t* pcm, int16_t* buffer, int frames) {
+public:
+	static constexpr std::size_t PIPELINE_SIZE = 128;
+	struct Settings {
+		const char* device = "default";
+		int period_size = 512; // in frames
+		int periods = 2;
+		bool mmap = false; // write directly into the device buffer
+		bool float_format = false; // 32-bit float samples instead of 16-bit integers
+		bool realtime = false; // run with SCHED_FIFO priority, needs the corresponding privileges
+		int lookahead = 0; // number of blocks rendered ahead on a separate thread, at most PIPELINE_SIZE
+	};
+	// can be read from another thread while running, times are in microseconds
+	struct Statistics {
+		std::atomic<long> periods{0};
+		std::atomic<long> xruns{0};
+		std::atomic<long> render_time{0}; // of the last period, or of the last block with lookahead
+		std::atomic<long> worst_render_time{0};
+		std::atomic<long> worst_headroom{0}; // least audio left in the device buffer when a period was written
+		// with lookahead: blocks ready when the output thread needed the next one, and how often there was none
+		std::atomic<long> fill{0};
+		std::atomic<long> lowest_fill{0};
+		std::atomic<long> starved{0};
+	};
+private:
+	Settings settings;
+	snd_pcm_t* pcm = nullptr;
+	snd_pcm_uframes_t period_size;
+	snd_pcm_uframes_t buffer_size;
+	std::vector<Sample> period;
+	SPSCQueue<std::array<Sample, BLOCK_SIZE>, PIPELINE_SIZE> pipeline;
+	static bool check(int result, const char* what) {
+		if (result < 0) {
+			fprintf(stderr, "ALSAOutput error: %s: %s\n", what, snd_strerror(result));
+			return false;
+		}
+		return true;
+	}
+	static long to_microseconds(std::chrono::steady_clock::duration duration) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+	}
+	static void convert(const Sample* input, int16_t* output, int frames) {
+		for (int i = 0; i < frames; ++i) {
+			output[i*2] = quantize(input[i].left * 32767.f, 32767.f);
+			output[i*2+1] = quantize(input[i].right * 32767.f, 32767.f);
+		}
+	}
+	static void convert(const Sample* input, float* output, int frames) {
+		for (int i = 0; i < frames; ++i) {
+			output[i*2] = input[i].left;
+			output[i*2+1] = input[i].right;
+		}
+	}
+	template <class T> void convert(const Sample* input, void* output, int frames) {
+		convert(input, static_cast<T*>(output), frames);
+	}
+	void convert(const Sample* input, void* output, int frames) {
+		if (settings.float_format) {
+			convert<float>(input, output, frames);
+		} else {
+			convert<int16_t>(input, output, frames);
+		}
+	}
+	bool recover(int error) {
+		if (error == -EPIPE || error == -ESTRPIPE) {
+			++statistics.xruns;
+		}
+		return check(snd_pcm_recover(pcm, error, 1), "recover");
+	}
+	bool open() {
+		if (!check(snd_pcm_open(&pcm, settings.device, SND_PCM_STREAM_PLAYBACK, 0), "open")) {
+			return false;
+		}
+		snd_pcm_hw_params_t* hw_params;
+		snd_pcm_hw_params_alloca(&hw_params);
+		snd_pcm_hw_params_any(pcm, hw_params);
+		unsigned int rate = get_sample_rate();
+		unsigned int periods = settings.periods;
+		period_size = settings.period_size;
+		if (!check(snd_pcm_hw_params_set_access(pcm, hw_params, settings.mmap ? SND_PCM_ACCESS_MMAP_INTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED), "access")
+			|| !check(snd_pcm_hw_params_set_format(pcm, hw_params, settings.float_format ? SND_PCM_FORMAT_FLOAT : SND_PCM_FORMAT_S16), "format")
+			|| !check(snd_pcm_hw_params_set_channels(pcm, hw_params, 2), "channels")
+			|| !check(snd_pcm_hw_params_set_rate_near(pcm, hw_params, &rate, nullptr), "rate")
+			|| !check(snd_pcm_hw_params_set_period_size_near(pcm, hw_params, &period_size, nullptr), "period size")
+			|| !check(snd_pcm_hw_params_set_periods_near(pcm, hw_params, &periods, nullptr), "periods")
+			|| !check(snd_pcm_hw_params(pcm, hw_params), "hardware parameters")) {
+			return false;
+		}
+		if (rate != (unsigned int)get_sample_rate()) {
+			fprintf(stderr, "ALSAOutput error: sample rate %u instead of %u\n", rate, (unsigned int)get_sample_rate());
+		}
+		snd_pcm_get_params(pcm, &buffer_size, &period_size);
+		// start once the whole buffer is filled
+		snd_pcm_sw_params_t* sw_params;
+		snd_pcm_sw_params_alloca(&sw_params);
+		snd_pcm_sw_params_current(pcm, sw_params);
+		snd_pcm_sw_params_set_start_threshold(pcm, sw_params, buffer_size);
+		snd_pcm_sw_params_set_avail_min(pcm, sw_params, period_size);
+		if (!check(snd_pcm_sw_params(pcm, sw_params), "software parameters")) {
+			return false;
+		}
+		period.resize(period_size);
+		statistics.worst_headroom = std::numeric_limits<long>::max();
+		return check(snd_pcm_prepare(pcm), "prepare");
+	}
+	void close() {
+		if (pcm) {
+			snd_pcm_drain(pcm);
+			snd_pcm_close(pcm);
+			pcm = nullptr;
+		}
+	}
+	void set_realtime_priority() {
+		sched_param parameters = {};
+		parameters.sched_priority = sched_get_priority_max(SCHED_FIFO);
+		const int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters);
+		if (result != 0) {
+			fprintf(stderr, "ALSAOutput error: real-time priority: %s\n", strerror(result));
+		}
+	}
+	// waits until a whole period fits into the device buffer
+	bool wait() {
+		while (true) {
+			const snd_pcm_sframes_t available = snd_pcm_avail_update(pcm);
+			if (available < 0) {
+				if (!recover(available)) {
+					return false;
+				}
+			} else if ((snd_pcm_uframes_t)available >= period_size) {
+				update_headroom(available);
+				return true;
+			} else if (snd_pcm_state(pcm) == SND_PCM_STATE_PREPARED) {
+				// the start threshold is only applied to writes, not to mmap commits
+				snd_pcm_start(pcm);
+			} else {
+				const int result = snd_pcm_wait(pcm, -1);
+				if (result < 0 && !recover(result)) {
+					return false;
+				}
+			}
+		}
+	}
+	void update_headroom(snd_pcm_uframes_t available) {
+		if (snd_pcm_state(pcm) != SND_PCM_STATE_RUNNING) {
+			return;
+		}
+		const long headroom = (long)(buffer_size - std::min(available, buffer_size)) * 1000000 / (long)get_sample_rate();
+		if (headroom < statistics.worst_headroom) {
+			statistics.worst_headroom = headroom;
+		}
+	}
+	bool write_mmap(const Sample* input, snd_pcm_uframes_t frames) {
 		while (frames > 0) {
-			int frames_written = snd_pcm_writei(pcm, buffer, frames);
-			if (frames_written < 0) {
-				fprintf(stderr, "ALSAOutput error: %s\n", snd_strerror(frames_written));
-				snd_pcm_recover(pcm, frames_written, 0);
-				snd_pcm_prepare(pcm);
+			const snd_pcm_channel_area_t* areas = nullptr;
+			snd_pcm_uframes_t offset = 0;
+			snd_pcm_uframes_t size = frames;
+			int result = snd_pcm_mmap_begin(pcm, &areas, &offset, &size);
+			if (result < 0) {
+				if (!recover(result)) {
+					return false;
+				}
+				continue;
+			}
+			// interleaved: all channels share one area
+			char* destination = static_cast<char*>(areas[0].addr) + (areas[0].first + offset * areas[0].step) / 8;
+			convert(input, destination, size);
+			const snd_pcm_sframes_t committed = snd_pcm_mmap_commit(pcm, offset, size);
+			if (committed < 0) {
+				if (!recover(committed)) {
+					return false;
+				}
 				continue;
 			}
-			buffer += 2 * frames_written;
-			frames -= frames_written;
+			input += committed;
+			frames -= committed;
 		}
+		return true;
 	}
-public:
-	void run(Output<Sample>& input) {
-		constexpr int BUFFER_SIZE = 1024;
-		snd_pcm_t* pcm;
-		snd_pcm_open(&pcm, "default", SND_PCM_STREAM_PLAYBACK, 0);
-		snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16, SND_PCM_ACCESS_RW_INTERLEAVED, 2, 44100, 1, 20000);
-		snd_pcm_prepare(pcm);
-		int16_t buffer[BUFFER_SIZE * 2];
-		while (true) {
-			for (int i = 0; i < BUFFER_SIZE; ++i) {
-				const Sample sample = input.get(i);
-				buffer[i*2] = sample.left * 32767.f + .5f;
-				buffer[i*2+1] = sample.right * 32767.f + .5f;
+	bool write(const Sample* input, snd_pcm_uframes_t frames) {
+		std::array<char, 8 * 256> buffer;
+		while (frames > 0) {
+			const snd_pcm_uframes_t size = std::min<snd_pcm_uframes_t>(frames, 256);
+			convert(input, buffer.data(), size);
+			snd_pcm_uframes_t written = 0;
+			while (written < size) {
+				const snd_pcm_sframes_t result = snd_pcm_writei(pcm, buffer.data() + written * (settings.float_format ? 8 : 4), size - written);
+				if (result < 0) {
+					if (!recover(result)) {
+						return false;
+					}
+					continue;
+				}
+				written += result;
 			}
-			play_buffer(pcm, buffer, BUFFER_SIZE);
+			input += size;
+			frames -= size;
+		}
+		return true;
+	}
+	void render(Output<Sample>& input, int t, Sample* output, int frames) {
+		DenormalGuard guard;
+		const auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; i += BLOCK_SIZE) {
+			input.get_block(t + i, output + i, std::min(BLOCK_SIZE, frames - i));
+		}
+		statistics.render_time = to_microseconds(std::chrono::steady_clock::now() - start);
+		if (statistics.render_time > statistics.worst_render_time) {
+			statistics.worst_render_time = statistics.render_time.load();
 		}
-		snd_pcm_drain(pcm);
-		snd_pcm_close(pcm);
+	}
+	// fill(t, output, frames) provides the audio for every period
+	template <class F> void play(long frames, F&& fill) {
+		for (long t = 1; frames < 0 || t <= frames; t += period_size) {
+			const int size = frames < 0 ? period_size : std::min<long>(period_size, frames - t + 1);
+			if (settings.mmap && !wait()) {
+				break;
+			}
+			fill(t, period.data(), size);
+			if (!settings.mmap) {
+				const snd_pcm_sframes_t available = snd_pcm_avail_update(pcm);
+				if (available >= 0) {
+					update_headroom(available);
+				}
+			}
+			if (!(settings.mmap ? write_mmap(period.data(), size) : write(period.data(), size))) {
+				break;
+			}
+			++statistics.periods;
+		}
+	}
+	// renders on a separate thread into the pipeline while this thread feeds the device
+	void play_pipelined(Output<Sample>& input, long frames) {
+		const std::size_t lookahead = std::min(std::size_t(settings.lookahead), std::size_t(PIPELINE_SIZE));
+		std::atomic<bool> running(true);
+		std::atomic<bool> rendering(true);
+		std::thread renderer([&]() {
+			if (settings.realtime) {
+				set_realtime_priority();
+			}
+			std::array<Sample, BLOCK_SIZE> block;
+			for (long t = 1; running && (frames < 0 || t <= frames); t += BLOCK_SIZE) {
+				while (running && pipeline.get_size() >= lookahead) {
+					std::this_thread::sleep_for(std::chrono::duration<float>(BLOCK_SIZE * DT / 2.f));
+				}
+				if (!running) {
+					break;
+				}
+				render(input, t, block.data(), frames < 0 ? BLOCK_SIZE : std::min<long>(BLOCK_SIZE, frames - t + 1));
+				pipeline.put(block);
+			}
+			rendering = false;
+		});
+		while (rendering && pipeline.get_size() < lookahead) {
+			std::this_thread::yield();
+		}
+		statistics.lowest_fill = std::numeric_limits<long>::max();
+		std::array<Sample, BLOCK_SIZE> block;
+		int position = BLOCK_SIZE;
+		play(frames, [&](long t, Sample* output, int size) {
+			for (int i = 0; i < size;) {
+				if (position == BLOCK_SIZE) {
+					statistics.fill = pipeline.get_size();
+					if (statistics.fill < statistics.lowest_fill) {
+						statistics.lowest_fill = statistics.fill.load();
+					}
+					if (!pipeline.take(block)) {
+						++statistics.starved;
+						while (!pipeline.take(block)) {
+							std::this_thread::yield();
+						}
+					}
+					position = 0;
+				}
+				const int n = std::min(size - i, BLOCK_SIZE - position);
+				std::copy_n(block.data() + position, n, output + i);
+				i += n;
+				position += n;
+			}
+		});
+		running = false;
+		renderer.join();
+		while (pipeline.take(block)) {}
+	}
+public:
+	Statistics statistics;
+	ALSAOutput() {}
+	ALSAOutput(const Settings& settings): settings(settings) {}
+	// plays the given number of frames, or forever if frames is negative
+	void run(Output<Sample>& input, long frames = -1) {
+		if (!open()) {
+			close();
+			return;
+		}
+		if (settings.realtime) {
+			set_realtime_priority();
+		}
+		if (settings.lookahead > 0) {
+			play_pipelined(input, frames);
+		} else {
+			play(frames, [&](long t, Sample* output, int size) {
+				render(input, t, output, size);
+			});
+		}
+		close();
 	}
 };
 
-class ALSAInput {
+// MIDI events from all ALSA sequencer ports, use it through ALSAInput
+class ALSASequencer {
 	snd_seq_t* seq;
 	int this_client;
 	int this_port;
@@ -92,25 +372,40 @@ class ALSAInput {
 		}
 	}
 public:
-	ALSAInput() {
+	ALSASequencer() {
 		snd_seq_open(&seq, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK);
 		this_client = snd_seq_client_id(seq);
 		this_port = snd_seq_create_simple_port(seq, "MIDI input", SND_SEQ_PORT_CAP_WRITE|SND_SEQ_PORT_CAP_SUBS_WRITE, SND_SEQ_PORT_TYPE_APPLICATION);
 		connect();
 	}
-	MIDIEvent process() {
+	~ALSASequencer() {
+		snd_seq_close(seq);
+	}
+	bool receive(MIDIEvent& result) {
 		snd_seq_event_t* event;
-		if (snd_seq_event_input(seq, &event) >= 0) {
-			if (event->type == SND_SEQ_EVENT_NOTEON) {
-				return MIDIEvent::create_note_on(event->data.note.note, event->data.note.velocity, event->data.note.channel);
-			} else if (event->type == SND_SEQ_EVENT_NOTEOFF) {
-				return MIDIEvent::create_note_off(event->data.note.note, event->data.note.velocity, event->data.note.channel);
-			} else if (event->type == SND_SEQ_EVENT_CONTROLLER) {
-				return MIDIEvent(0xB0 | event->data.control.channel, event->data.control.param, event->data.control.value);
-			}
+		if (snd_seq_event_input(seq, &event) < 0) {
+			// wait for the next event, but return regularly so that the receiving thread can be stopped
+			pollfd descriptors[4];
+			const int count = snd_seq_poll_descriptors(seq, descriptors, 4, POLLIN);
+			poll(descriptors, count, 10);
+			return false;
+		}
+		if (event->type == SND_SEQ_EVENT_NOTEON) {
+			result = MIDIEvent::create_note_on(event->data.note.note, event->data.note.velocity, event->data.note.channel);
+		} else if (event->type == SND_SEQ_EVENT_NOTEOFF) {
+			result = MIDIEvent::create_note_off(event->data.note.note, event->data.note.velocity, event->data.note.channel);
+		} else if (event->type == SND_SEQ_EVENT_CONTROLLER) {
+			result = MIDIEvent(0xB0 | event->data.control.channel, event->data.control.param, event->data.control.value);
+		} else {
+			return false;
 		}
-		return MIDIEvent();
+		return true;
 	}
 };
 
+// MIDI input node for processors that take MIDIEvents like Voices, the sequencer is read on a separate thread
+// processors that take a MIDIEvent like Frequency and ADSR take it through a Node2<OneEventPerFrame>
+using ALSAInput = MIDIReceiver<ALSASequencer>;
+
+
 } // namespace modo
@@ -0,0 +1,1087 @@
+#include "../modo.hh"
+#include "../leslie.hh"
+#include "../thread.hh"
+#include "reference.hh"
+#include <chrono>
+#include <memory>
+#include <cstdio>
+
+using namespace modo;
+
+namespace reference {
+
+// the original scalar implementation, kept to check the vectorized one against
+class Freeverb {
+	// freeverb algorithm by Jezar at Dreampoint
+	template <std::size_t N> class Comb {
+		std::array<float, N> buffer;
+		std::size_t position;
+		float previous;
+	public:
+		Comb(): buffer(), position(0), previous(0.f) {}
+		float process(float input, float feedback, float damp) {
+			const float output = buffer[position];
+			// low-pass filter
+			const float filtered = output * (1.f - damp) + previous * damp;
+			previous = filtered;
+			buffer[position] = input + filtered * feedback;
+			position = (position + 1) % N;
+			return output;
+		}
+	};
+	template <std::size_t N> class AllPass {
+		std::array<float, N> buffer;
+		std::size_t position;
+	public:
+		AllPass(): buffer(), position(0) {}
+		float process(float input) {
+			constexpr float feedback = .5f;
+			const float output = buffer[position];
+			buffer[position] = input + output * feedback;
+			position = (position + 1) % N;
+			return output - input;
+		}
+	};
+	template <std::size_t S> class Channel {
+		Comb<1116+S> comb1;
+		Comb<1188+S> comb2;
+		Comb<1277+S> comb3;
+		Comb<1356+S> comb4;
+		Comb<1422+S> comb5;
+		Comb<1491+S> comb6;
+		Comb<1557+S> comb7;
+		Comb<1617+S> comb8;
+		AllPass<556+S> all_pass1;
+		AllPass<441+S> all_pass2;
+		AllPass<341+S> all_pass3;
+		AllPass<225+S> all_pass4;
+	public:
+		float process(float input, float feedback, float damp) {
+			float result = 0.f;
+			// process comb filters in parallel
+			result += comb1.process(input, feedback, damp);
+			result += comb2.process(input, feedback, damp);
+			result += comb3.process(input, feedback, damp);
+			result += comb4.process(input, feedback, damp);
+			result += comb5.process(input, feedback, damp);
+			result += comb6.process(input, feedback, damp);
+			result += comb7.process(input, feedback, damp);
+			result += comb8.process(input, feedback, damp);
+			// process all-pass filters in series
+			result = all_pass1.process(result);
+			result = all_pass2.process(result);
+			result = all_pass3.process(result);
+			result = all_pass4.process(result);
+			return result;
+		}
+	};
+	Channel<0> channel1;
+	Channel<23> channel2;
+public:
+	Sample process(float input, float room_size, float damp, float wet, float dry, float width) {
+		const float _input = input * .03f;
+		const float feedback = room_size * .28f + .7f;
+		damp = damp * .4f;
+		wet = wet * 3.f;
+		dry = dry * 2.f;
+		const float output1 = channel1.process(_input, feedback, damp);
+		const float output2 = channel2.process(_input, feedback, damp);
+		return Width::process(Sample(output1, output2), width) * wet + Sample(input) * dry;
+	}
+};
+
+// the original noise, drawing from one shared generator
+class Random {
+public:
+	static uint64_t get() {
+		static Xorshift128plus generator;
+		return generator.get_next();
+	}
+	static float get_float() {
+		return get() / static_cast<float>(0xFFFFFFFFFFFFFFFF);
+	}
+};
+class Noise {
+public:
+	float process() {
+		return Random::get_float() * 2.f - 1.f;
+	}
+};
+
+// the original delay effects on a RingBuffer, which wraps with a modulo on every access
+template <std::size_t N> class Delay {
+	RingBuffer<float, N> buffer;
+public:
+	Sample process(float input, float feedback, float wet, float dry, float width) {
+		const float left = buffer[0] * (feedback * feedback);
+		const float right = buffer[N/2] * feedback;
+		buffer[0] = input + left;
+		++buffer;
+		return Width::process(Sample(left, right), width) * wet + Sample(input) * dry;
+	}
+};
+class Leslie {
+	RingBuffer<float, 32> buffer;
+	float sin = 0.f;
+	float cos = 1.f;
+	float get_linear(float i) {
+		std::size_t lower = i;
+		float factor = i - lower;
+		std::size_t upper = lower + 1;
+		return buffer[lower] * (1.f - factor) + buffer[upper] * factor;
+	}
+public:
+	Sample process(float input, float frequency_factor) {
+		--buffer;
+		buffer[0] = input;
+		const float f = .0002f * frequency_factor;
+		cos += -sin * f;
+		sin += cos * f;
+		return Pan::process(get_linear(sin * 15.f + 16.f), cos * .3f) + Pan::process(get_linear(sin * -15.f + 16.f), cos * -.3f);
+	}
+};
+
+// the original resonator, whose state decays into denormals
+class Resonator {
+	float s0 = 0.f;
+	float s1 = 0.f;
+public:
+	float process(float input, float frequency, float sensitivity) {
+		for (int i = 0; i < 2; ++i) {
+			s0 = s0 - s1*frequency + (input - s0)*frequency*sensitivity;
+			s1 = s1 + s0*frequency;
+		}
+		return s1;
+	}
+};
+
+} // namespace reference
+
+// returns the fastest of several runs in seconds
+template <class F> double measure(F&& f, int runs = 5) {
+	double best = INFINITY;
+	for (int run = 0; run < runs; ++run) {
+		const auto start = std::chrono::steady_clock::now();
+		f();
+		best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+void benchmark_freeverb() {
+	constexpr int FRAMES = 44100 * 5;
+	static float input[FRAMES];
+	Noise noise;
+	noise.process_block(input, FRAMES);
+	static Sample scalar_output[FRAMES];
+	static Sample block_output[FRAMES];
+	reference::Freeverb scalar;
+	const double scalar_time = measure([&]() {
+		for (int i = 0; i < FRAMES; ++i) {
+			scalar_output[i] = scalar.process(input[i], .8f, .5f, .3f, .7f, 1.f);
+		}
+	});
+	Freeverb block;
+	const double block_time = measure([&]() {
+		float room_size[BLOCK_SIZE], damp[BLOCK_SIZE], wet[BLOCK_SIZE], dry[BLOCK_SIZE], width[BLOCK_SIZE];
+		std::fill_n(room_size, BLOCK_SIZE, .8f);
+		std::fill_n(damp, BLOCK_SIZE, .5f);
+		std::fill_n(wet, BLOCK_SIZE, .3f);
+		std::fill_n(dry, BLOCK_SIZE, .7f);
+		std::fill_n(width, BLOCK_SIZE, 1.f);
+		for (int i = 0; i < FRAMES; i += BLOCK_SIZE) {
+			block.process_block(input + i, room_size, damp, wet, dry, width, block_output + i, std::min(BLOCK_SIZE, FRAMES - i));
+		}
+	});
+	float error = 0.f;
+	for (int i = 0; i < FRAMES; ++i) {
+		error = std::max(error, std::abs(scalar_output[i].left - block_output[i].left));
+		error = std::max(error, std::abs(scalar_output[i].right - block_output[i].right));
+	}
+	printf("Freeverb reference: %.2f ns/sample\n", scalar_time * 1e9 / FRAMES);
+	printf("Freeverb block:     %.2f ns/sample (max difference %g)\n", block_time * 1e9 / FRAMES, error);
+}
+
+class Tone {
+	Osc osc;
+public:
+	float process() {
+		return osc.process(440.f);
+	}
+};
+
+template <class T> double render(T& node, int frames) {
+	return measure([&]() {
+		Sample buffer[BLOCK_SIZE];
+		for (int t = 1; t <= frames; t += BLOCK_SIZE) {
+			node.get_block(t, buffer, BLOCK_SIZE);
+		}
+	});
+}
+
+void benchmark_chain() {
+	constexpr int FRAMES = 44100 * 5;
+	Node2<Tone> tone;
+	Node2<LowPass> low_pass;
+	Node2<Pan> pan;
+	low_pass.connect(tone, .3f);
+	pan.connect(low_pass, .5f);
+	Node2<Chain<Chain<Tone, LowPass>, Pan>> chain;
+	chain.connect(.3f, .5f);
+	printf("Node2 graph: %.2f ns/sample\n", render(pan, FRAMES) * 1e9 / FRAMES);
+	printf("Chain:       %.2f ns/sample\n", render(chain, FRAMES) * 1e9 / FRAMES);
+}
+
+// one voice per lane of the widest vector registers, wider vectors would be passed through memory
+constexpr std::size_t VOICES = NATIVE_LANES;
+
+class PolySynth {
+	PolySaw<VOICES> saw;
+	PolyADSR<VOICES> adsr;
+public:
+	Vector<float, VOICES> process(const VoiceState<VOICES>& voices) {
+		return saw.process(voices.frequency) * adsr.process(voices, 10.f, 200.f, .5f, 300.f) * voices.velocity;
+	}
+};
+
+class MonoSynth {
+	Frequency frequency;
+	Velocity velocity;
+	Saw saw;
+	ADSR adsr;
+public:
+	float process(MIDIEvent event) {
+		return saw.process(frequency.process(event)) * adsr.process(event, 10.f, 200.f, .5f, 300.f) * velocity.process(event);
+	}
+};
+
+// the best of five runs each, since a single run of a few ns per sample varies by about 10% here
+void benchmark_voices() {
+	constexpr int FRAMES = 44100 * 5;
+	// a chord at the start, read from memory so that the compiler cannot specialize for it
+	static std::array<MIDIEvent, VOICES> events[FRAMES];
+	for (std::size_t voice = 0; voice < VOICES; ++voice) {
+		events[0][voice] = MIDIEvent::create_note_on(60 + voice * 2, 100, 0);
+	}
+	volatile float sink;
+	Voices<PolySynth, VOICES> voices;
+	const double poly_time = measure([&]() {
+		float result = 0.f;
+		for (int t = 0; t < FRAMES; ++t) {
+			MIDIEvents chord;
+			for (MIDIEvent event: events[t]) {
+				chord.add(event);
+			}
+			result += voices.process(chord);
+		}
+		sink = result;
+	});
+	// the way a Node2<Voices> runs it
+	static MIDIEvents chords[FRAMES];
+	for (int t = 0; t < FRAMES; ++t) {
+		for (MIDIEvent event: events[t]) {
+			chords[t].add(event);
+		}
+	}
+	Voices<PolySynth, VOICES> block_voices;
+	const double block_time = measure([&]() {
+		float result = 0.f;
+		for (int t = 0; t < FRAMES; t += BLOCK_SIZE) {
+			float output[BLOCK_SIZE];
+			block_voices.process_block(chords + t, output, std::min(BLOCK_SIZE, FRAMES - t));
+			result += output[0];
+		}
+		sink = result;
+	});
+	std::array<MonoSynth, VOICES> synths;
+	const double mono_time = measure([&]() {
+		float result = 0.f;
+		for (int t = 0; t < FRAMES; ++t) {
+			for (std::size_t voice = 0; voice < VOICES; ++voice) {
+				result += synths[voice].process(events[t][voice]);
+			}
+		}
+		sink = result;
+	});
+	printf("%zu mono synths:          %.2f ns/sample\n", VOICES, mono_time * 1e9 / FRAMES);
+	printf("Voices<%zu>:              %.2f ns/sample\n", VOICES, poly_time * 1e9 / FRAMES);
+	printf("Voices<%zu>, by blocks:   %.2f ns/sample\n", VOICES, block_time * 1e9 / FRAMES);
+}
+
+void benchmark_automation() {
+	constexpr int FRAMES = 44100 * 5;
+	// a drum hit retriggered every 100 ms
+	constexpr int HIT = 4410;
+	const char* envelope = "0 .9/.01 .3/.02 .1/.03 0/.04";
+	volatile float sink;
+	reference::Automation parsed(envelope);
+	const double parsed_time = measure([&]() {
+		float result = 0.f;
+		for (int t = 0; t < FRAMES; ++t) {
+			if (t % HIT == 0) {
+				parsed.reset();
+			}
+			result += parsed.process();
+		}
+		sink = result;
+	});
+	Automation compiled(envelope);
+	const double compiled_time = measure([&]() {
+		float result = 0.f;
+		for (int t = 0; t < FRAMES; ++t) {
+			if (t % HIT == 0) {
+				compiled.reset();
+			}
+			result += compiled.process();
+		}
+		sink = result;
+	});
+	Automation block(envelope);
+	const double block_time = measure([&]() {
+		float buffer[BLOCK_SIZE];
+		float result = 0.f;
+		for (int t = 0; t < FRAMES; t += BLOCK_SIZE) {
+			if (t % HIT < BLOCK_SIZE) {
+				block.reset();
+			}
+			block.process_block(buffer, BLOCK_SIZE);
+			result += buffer[0];
+		}
+		sink = result;
+	});
+	printf("Automation parsed:   %.2f ns/sample\n", parsed_time * 1e9 / FRAMES);
+	printf("Automation compiled: %.2f ns/sample\n", compiled_time * 1e9 / FRAMES);
+	printf("Automation block:    %.2f ns/sample\n", block_time * 1e9 / FRAMES);
+}
+
+void benchmark_noise() {
+	constexpr int FRAMES = 44100 * 5;
+	static float output[FRAMES];
+	reference::Noise shared;
+	const double shared_time = measure([&]() {
+		for (int i = 0; i < FRAMES; ++i) {
+			output[i] = shared.process();
+		}
+	});
+	Noise scalar;
+	const double scalar_time = measure([&]() {
+		for (int i = 0; i < FRAMES; ++i) {
+			output[i] = scalar.process();
+		}
+	});
+	Noise block;
+	const double block_time = measure([&]() {
+		for (int i = 0; i < FRAMES; i += BLOCK_SIZE) {
+			block.process_block(output + i, std::min(BLOCK_SIZE, FRAMES - i));
+		}
+	});
+	// the same seed has to give the same sequence, however it is split into blocks
+	Noise a(1);
+	Noise b(1);
+	bool reproducible = true;
+	for (int n = 1; n < 20; ++n) {
+		float block_values[20];
+		b.process_block(block_values, n);
+		for (int i = 0; i < n; ++i) {
+			reproducible &= a.process() == block_values[i];
+		}
+	}
+	printf("Noise shared:        %.2f ns/sample\n", shared_time * 1e9 / FRAMES);
+	printf("Noise scalar:        %.2f ns/sample\n", scalar_time * 1e9 / FRAMES);
+	printf("Noise block:         %.2f ns/sample (%s)\n", block_time * 1e9 / FRAMES, reproducible ? "reproducible" : "NOT reproducible");
+}
+
+// times a stereo effect against its reference on the same input, and prints the largest difference
+template <class R, class E, class F> void compare_effect(const char* name, const float* input, int frames, F&& process) {
+	static std::vector<Sample> reference_output;
+	static std::vector<Sample> output;
+	reference_output.resize(frames);
+	output.resize(frames);
+	R reference_effect;
+	const double reference_time = measure([&]() {
+		for (int i = 0; i < frames; ++i) {
+			reference_output[i] = process(reference_effect, input[i]);
+		}
+	});
+	E effect;
+	const double time = measure([&]() {
+		for (int i = 0; i < frames; ++i) {
+			output[i] = process(effect, input[i]);
+		}
+	});
+	float difference = 0.f;
+	for (int i = 0; i < frames; ++i) {
+		difference = std::max({difference, std::abs(output[i].left - reference_output[i].left), std::abs(output[i].right - reference_output[i].right)});
+	}
+	printf("%s reference: %.2f ns/sample\n", name, reference_time * 1e9 / frames);
+	printf("%s:           %.2f ns/sample (max difference %g)\n", name, time * 1e9 / frames, difference);
+}
+
+void benchmark_delay() {
+	constexpr int FRAMES = 44100 * 5;
+	static float input[FRAMES];
+	Noise noise;
+	noise.process_block(input, FRAMES);
+	compare_effect<reference::Delay<11025>, Delay<11025>>("Delay ", input, FRAMES, [](auto& delay, float x) {
+		return delay.process(x, .7f, .5f, 1.f, .5f);
+	});
+	compare_effect<reference::Leslie, Leslie>("Leslie", input, FRAMES, [](auto& leslie, float x) {
+		return leslie.process(x, 30.f);
+	});
+	Chorus chorus;
+	volatile float sink;
+	const double chorus_time = measure([&]() {
+		float result = 0.f;
+		for (int i = 0; i < FRAMES; ++i) {
+			result += chorus.process(input[i], .8f, .02f, .005f, .5f, 1.f).left;
+		}
+		sink = result;
+	});
+	DelayLine line(4096);
+	static float output[FRAMES];
+	const double block_time = measure([&]() {
+		for (int i = 0; i < FRAMES; i += BLOCK_SIZE) {
+			const int n = std::min(BLOCK_SIZE, FRAMES - i);
+			line.write_block(input + i, n);
+			line.read_block(1000.5f, output + i, n);
+		}
+	});
+	printf("Chorus:            %.2f ns/sample\n", chorus_time * 1e9 / FRAMES);
+	printf("DelayLine block:   %.2f ns/sample\n", block_time * 1e9 / FRAMES);
+}
+
+// the LowPass coefficient for a cutoff frequency in Hz
+class Coefficient {
+public:
+	static float process(float frequency) {
+		return 1.f - std::exp(-2.f * PI * DT * frequency);
+	}
+};
+
+// a tone whose filter cutoff and panning follow envelopes, evaluated every K samples
+template <int K> struct ModulatedVoice {
+	Node2<Tone> tone;
+	Node2<Automation> cutoff{"100 4000^.1 500^.9 2000^2 200^2", K};
+	Node2<Coefficient> coefficient;
+	Node2<Automation> panning{"-1 1/2 -1/2 1/1", K};
+	ControlRate<float, K> cutoff_control;
+	ControlRate<float, K> panning_control;
+	Node2<LowPass> low_pass;
+	Node2<Pan> pan;
+	ModulatedVoice() {
+		coefficient.connect(cutoff);
+		if (K == 1) {
+			low_pass.connect(tone, coefficient);
+			pan.connect(low_pass, panning);
+		}
+		else {
+			cutoff_control.connect(coefficient);
+			panning_control.connect(panning);
+			low_pass.connect(tone, cutoff_control);
+			pan.connect(low_pass, panning_control);
+		}
+	}
+};
+
+template <int K> double render_modulated_voices(int frames, std::vector<Sample>& output) {
+	std::vector<std::unique_ptr<ModulatedVoice<K>>> voices;
+	for (int i = 0; i < 16; ++i) {
+		voices.emplace_back(new ModulatedVoice<K>());
+	}
+	output.assign(frames, Sample());
+	return measure([&]() {
+		Sample buffer[BLOCK_SIZE];
+		for (int t = 1; t <= frames; t += BLOCK_SIZE) {
+			const int n = std::min(BLOCK_SIZE, frames - t + 1);
+			for (auto& voice: voices) {
+				voice->pan.get_block(t, buffer, n);
+				for (int i = 0; i < n; ++i) {
+					output[t - 1 + i] = output[t - 1 + i] + buffer[i];
+				}
+			}
+		}
+	}, 1);
+}
+
+void benchmark_control_rate() {
+	constexpr int FRAMES = 44100 * 5;
+	std::vector<Sample> audio_rate;
+	std::vector<Sample> control_rate;
+	const double audio_time = render_modulated_voices<1>(FRAMES, audio_rate);
+	const double control_time = render_modulated_voices<BLOCK_SIZE>(FRAMES, control_rate);
+	const double control_time_16 = render_modulated_voices<16>(FRAMES, control_rate);
+	float difference = 0.f;
+	for (int i = 0; i < FRAMES; ++i) {
+		difference = std::max({difference, std::abs(audio_rate[i].left - control_rate[i].left), std::abs(audio_rate[i].right - control_rate[i].right)});
+	}
+	printf("16 modulated voices, audio rate:    %.2f ns/sample\n", audio_time * 1e9 / FRAMES);
+	printf("16 modulated voices, every 64:      %.2f ns/sample\n", control_time * 1e9 / FRAMES);
+	printf("16 modulated voices, every 16:      %.2f ns/sample (max difference %g)\n", control_time_16 * 1e9 / FRAMES, difference);
+}
+
+#ifndef MODO_SAMPLE_RATE
+// 16 modulated voices through a reverb, rendering seconds of audio at the given sample rate
+double render_at(float rate, float seconds) {
+	set_sample_rate(rate);
+	const int frames = seconds * rate;
+	std::vector<Sample> voices;
+	double time = render_modulated_voices<1>(frames, voices);
+	std::vector<float> input(frames);
+	for (int i = 0; i < frames; ++i) {
+		input[i] = Mono::process(voices[i]);
+	}
+	std::vector<Sample> output(frames);
+	Freeverb reverb;
+	time += measure([&]() {
+		float room_size[BLOCK_SIZE], damp[BLOCK_SIZE], wet[BLOCK_SIZE], dry[BLOCK_SIZE], width[BLOCK_SIZE];
+		std::fill_n(room_size, BLOCK_SIZE, .8f);
+		std::fill_n(damp, BLOCK_SIZE, .5f);
+		std::fill_n(wet, BLOCK_SIZE, .3f);
+		std::fill_n(dry, BLOCK_SIZE, .7f);
+		std::fill_n(width, BLOCK_SIZE, 1.f);
+		for (int i = 0; i < frames; i += BLOCK_SIZE) {
+			reverb.process_block(input.data() + i, room_size, damp, wet, dry, width, output.data() + i, std::min(BLOCK_SIZE, frames - i));
+		}
+	}, 1);
+	set_sample_rate(44100.f);
+	return time;
+}
+
+void benchmark_sample_rate() {
+	const double full = render_at(44100.f, 5.f);
+	const double draft = render_at(22050.f, 5.f);
+	const double high = render_at(96000.f, 5.f);
+	printf("5 s at 44.1 kHz: %.0f ms\n", full * 1e3);
+	printf("5 s at 22.05 kHz (draft): %.0f ms (%.2fx faster)\n", draft * 1e3, full / draft);
+	printf("5 s at 96 kHz: %.0f ms\n", high * 1e3);
+}
+#endif
+
+// largest error of fast against reference over the inputs, relative to reference if relative is set
+template <class F, class R> double measure_error(const std::vector<float>& inputs, F&& fast, R&& reference, bool relative) {
+	double error = 0.0;
+	for (float x: inputs) {
+		const double expected = reference(x);
+		const double difference = std::abs(fast(x) - expected);
+		error = std::max(error, relative ? difference / std::abs(expected) : difference);
+	}
+	return error;
+}
+
+// time per value of f applied to a whole array, the way a block would use it
+template <class F> double measure_throughput(const std::vector<float>& inputs, F&& f) {
+	static std::vector<float> output;
+	output.resize(inputs.size());
+	return measure([&]() {
+		for (int run = 0; run < 100; ++run) {
+			for (std::size_t i = 0; i < inputs.size(); ++i) {
+				output[i] = f(inputs[i]);
+			}
+		}
+	}) / (100.0 * inputs.size());
+}
+
+// the same for f applied to NATIVE_LANES lanes at a time
+template <class F> double measure_vector_throughput(const std::vector<float>& inputs, F&& f) {
+	using Floats = Vector<float, NATIVE_LANES>;
+	static std::vector<float> output;
+	output.resize(inputs.size());
+	const Floats* in = reinterpret_cast<const Floats*>(inputs.data());
+	Floats* out = reinterpret_cast<Floats*>(output.data());
+	return measure([&]() {
+		for (int run = 0; run < 100; ++run) {
+			for (std::size_t i = 0; i < inputs.size() / NATIVE_LANES; ++i) {
+				out[i] = f(in[i]);
+			}
+		}
+	}) / (100.0 * inputs.size());
+}
+
+std::vector<float> range(float first, float last, int count) {
+	std::vector<float> result(count);
+	for (int i = 0; i < count; ++i) {
+		result[i] = first + (last - first) * i / (count - 1);
+	}
+	return result;
+}
+
+void benchmark_fast_math() {
+	const std::vector<float> exponents = range(-126.f, 126.f, 1 << 20);
+	std::vector<float> positives(1 << 20);
+	for (std::size_t i = 0; i < positives.size(); ++i) {
+		positives[i] = std::exp2(-125.f + 250.f * i / positives.size());
+	}
+	const std::vector<float> small_exponents = range(-1.f, 1.f, 1 << 20);
+	const std::vector<float> arguments = range(-10.f, 10.f, 1 << 20);
+	auto exp2 = [](float x) { return std::exp2(x); };
+	auto log2 = [](float x) { return std::log2(x); };
+	auto pow = [](float x) { return std::pow(.01f, x); };
+	auto tanh = [](float x) { return std::tanh(x); };
+	auto exp2_fast = [](float x) { return fast_exp2(x); };
+	auto log2_fast = [](float x) { return fast_log2(x); };
+	auto pow_fast = [](float x) { return fast_pow(.01f, x); };
+	auto tanh_fast = [](float x) { return fast_tanh(x); };
+	using Floats = Vector<float, NATIVE_LANES>;
+	auto exp2_vector = [](Floats x) { return fast_exp2(x); };
+	auto log2_vector = [](Floats x) { return fast_log2(x); };
+	auto pow_vector = [](Floats x) { return fast_pow(broadcast<Floats>(.01f), x); };
+	auto tanh_vector = [](Floats x) { return fast_tanh(x); };
+	printf("exp2: relative error %.2g, %.2f ns, %zu lanes %.2f ns (libm %.2f ns)\n",
+		measure_error(exponents, exp2_fast, [](float x) { return std::exp2(double(x)); }, true),
+		measure_throughput(exponents, exp2_fast) * 1e9, NATIVE_LANES, measure_vector_throughput(exponents, exp2_vector) * 1e9, measure_throughput(exponents, exp2) * 1e9);
+	printf("log2: absolute error %.2g, %.2f ns, %zu lanes %.2f ns (libm %.2f ns)\n",
+		measure_error(positives, log2_fast, [](float x) { return std::log2(double(x)); }, false),
+		measure_throughput(positives, log2_fast) * 1e9, NATIVE_LANES, measure_vector_throughput(positives, log2_vector) * 1e9, measure_throughput(positives, log2) * 1e9);
+	printf("pow(.01, y), |y| <= 1: relative error %.2g, %.2f ns, %zu lanes %.2f ns (libm %.2f ns)\n",
+		measure_error(small_exponents, pow_fast, [](float x) { return std::pow(.01, double(x)); }, true),
+		measure_throughput(small_exponents, pow_fast) * 1e9, NATIVE_LANES, measure_vector_throughput(small_exponents, pow_vector) * 1e9, measure_throughput(small_exponents, pow) * 1e9);
+	printf("tanh: absolute error %.2g, %.2f ns, %zu lanes %.2f ns (libm %.2f ns)\n",
+		measure_error(arguments, tanh_fast, [](float x) { return std::tanh(double(x)); }, false),
+		measure_throughput(arguments, tanh_fast) * 1e9, NATIVE_LANES, measure_vector_throughput(arguments, tanh_vector) * 1e9, measure_throughput(arguments, tanh) * 1e9);
+}
+
+// T without its get_tail, so that a Node2<Awake<T>> never sleeps
+template <class T> class Awake: public T {
+public:
+	using T::T;
+	int get_tail() const = delete;
+};
+template <class T> using Asleep = T;
+
+// a tone or filtered noise, shaped by an envelope and panned
+template <template <class> class W> struct Drum {
+	Node2<Pattern<1>> pattern;
+	Node2<W<ADSR>> envelope;
+	Node2<Osc> osc;
+	Node2<Noise> noise;
+	Node2<W<LowPass>> filter;
+	Node2<W<Amplifier>> amplifier;
+	Node2<W<Pan>> pan;
+	// noise if frequency is 0
+	Drum(Output<MIDIEvent>& clock, const char* steps, float frequency, float decay, float panning): pattern(std::array<NotePattern, 1>{NotePattern(36, steps)}) {
+		pattern.connect(clock);
+		envelope.connect(pattern, 1.f, decay, 0.f, 50.f);
+		if (frequency > 0.f) {
+			osc.connect(frequency);
+			amplifier.connect(envelope, osc);
+		}
+		else {
+			filter.connect(noise, .3f);
+			amplifier.connect(envelope, filter);
+		}
+		pan.connect(amplifier, panning);
+	}
+};
+
+// four drums playing a few hits in 8 bars, through a delay and a reverb
+template <template <class> class W> struct Arrangement {
+	Node2<MIDIClock> clock;
+	std::vector<std::unique_ptr<Drum<W>>> drums;
+	ThreadPool pool{1};
+	ParallelMix mix{pool};
+	Node2<W<Mono>> mono;
+	Node2<W<Delay<11025>>> delay;
+	Node2<W<Mono>> delay_mono;
+	Node2<W<Freeverb>> reverb;
+	Arrangement(const std::vector<std::string>& patterns) {
+		clock.connect(120.f);
+		const float frequencies[] = {55.f, 0.f, 0.f, 110.f};
+		const float decays[] = {300.f, 200.f, 50.f, 400.f};
+		const float pannings[] = {0.f, -.3f, .5f, .3f};
+		for (int i = 0; i < 4; ++i) {
+			drums.emplace_back(new Drum<W>(clock, patterns[i].c_str(), frequencies[i], decays[i], pannings[i]));
+			mix.add(drums.back()->pan);
+		}
+		mono.connect(mix);
+		delay.connect(mono, .3f, .3f, 1.f, .5f);
+		delay_mono.connect(delay);
+		reverb.connect(delay_mono, .5f, .5f, .3f, .7f, 1.f);
+	}
+};
+
+template <template <class> class W> double render_arrangement(const std::vector<std::string>& patterns, int frames, int& silent_blocks) {
+	Arrangement<W> arrangement(patterns);
+	silent_blocks = 0;
+	return measure([&]() {
+		Sample buffer[BLOCK_SIZE];
+		for (int t = 1; t <= frames; t += BLOCK_SIZE) {
+			silent_blocks += arrangement.reverb.get_block_silent(t, buffer, std::min(BLOCK_SIZE, frames - t + 1));
+		}
+	}, 1);
+}
+
+void benchmark_sleeping() {
+	// 128 sixteenth steps, 16 seconds at 120 bpm
+	auto steps = [](std::initializer_list<int> hits) {
+		std::string steps(128, ' ');
+		for (int hit: hits) {
+			steps[hit] = '8';
+		}
+		return steps;
+	};
+	// two short phrases with long rests in between
+	const std::vector<std::string> patterns = {
+		steps({0, 64}),
+		steps({8, 72}),
+		steps({4, 68, 70}),
+		steps({12, 76})
+	};
+	const int frames = 16 * 44100 * 2;
+	int silent_blocks = 0;
+	const double awake = render_arrangement<Awake>(patterns, frames, silent_blocks);
+	const double asleep = render_arrangement<Asleep>(patterns, frames, silent_blocks);
+	const int blocks = (frames + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	printf("sparse drums, always awake:  %.2f ns/sample\n", awake * 1e9 / frames);
+	printf("sparse drums, sleeping:      %.2f ns/sample (%.0f%% of the CPU, %d of %d output blocks silent)\n", asleep * 1e9 / frames, asleep / awake * 100., silent_blocks, blocks);
+}
+
+// renders the response of a new T to an impulse in windows of one second and prints the time of the first and
+// the slowest window, each the best of three runs; process(processor, input, n) processes n samples of input
+template <class T, class F> void measure_decay(const char* name, int seconds, F&& process) {
+	constexpr int WINDOW = 44100;
+	std::vector<float> impulse(WINDOW);
+	impulse[0] = 1.f;
+	const std::vector<float> silence(WINDOW);
+	std::vector<double> times(seconds, INFINITY);
+	for (int run = 0; run < 3; ++run) {
+		std::unique_ptr<T> processor(new T());
+		for (int second = 0; second < seconds; ++second) {
+			const float* input = second == 0 ? impulse.data() : silence.data();
+			times[second] = std::min(times[second], measure([&]() {
+				process(*processor, input, WINDOW);
+			}, 1));
+		}
+	}
+	const double slowest = *std::max_element(times.begin(), times.end());
+	printf("%-34s first second %6.2f ns/sample, slowest %6.2f ns/sample (%.1fx)\n", name, times[0] * 1e9 / WINDOW, slowest * 1e9 / WINDOW, slowest / times[0]);
+}
+
+// keeps the compiler from dropping the processing
+volatile float sink;
+
+void benchmark_denormals() {
+	constexpr int SECONDS = 20;
+	measure_decay<reference::Freeverb>("Freeverb reference", SECONDS, [](reference::Freeverb& reverb, const float* input, int n) {
+		for (int i = 0; i < n; ++i) {
+			sink = sink + reverb.process(input[i], .2f, .5f, .3f, .7f, 1.f).left;
+		}
+	});
+	measure_decay<reference::Freeverb>("Freeverb reference, DenormalGuard", SECONDS, [](reference::Freeverb& reverb, const float* input, int n) {
+		DenormalGuard guard;
+		for (int i = 0; i < n; ++i) {
+			sink = sink + reverb.process(input[i], .2f, .5f, .3f, .7f, 1.f).left;
+		}
+	});
+	measure_decay<Freeverb>("Freeverb, cleared when silent", SECONDS, [](Freeverb& reverb, const float* input, int n) {
+		float room_size[BLOCK_SIZE], damp[BLOCK_SIZE], wet[BLOCK_SIZE], dry[BLOCK_SIZE], width[BLOCK_SIZE];
+		std::fill_n(room_size, BLOCK_SIZE, .2f);
+		std::fill_n(damp, BLOCK_SIZE, .5f);
+		std::fill_n(wet, BLOCK_SIZE, .3f);
+		std::fill_n(dry, BLOCK_SIZE, .7f);
+		std::fill_n(width, BLOCK_SIZE, 1.f);
+		Sample output[BLOCK_SIZE];
+		for (int i = 0; i < n; i += BLOCK_SIZE) {
+			reverb.process_block(input + i, room_size, damp, wet, dry, width, output, std::min(BLOCK_SIZE, n - i));
+			sink = sink + output[0].left;
+		}
+	});
+	measure_decay<reference::Resonator>("Resonator reference", SECONDS, [](reference::Resonator& resonator, const float* input, int n) {
+		for (int i = 0; i < n; ++i) {
+			sink = sink + resonator.process(input[i], .01f, .01f);
+		}
+	});
+	measure_decay<Resonator>("Resonator, flushing", SECONDS, [](Resonator& resonator, const float* input, int n) {
+		for (int i = 0; i < n; ++i) {
+			sink = sink + resonator.process(input[i], .01f, .01f);
+		}
+	});
+	measure_decay<reference::Delay<11025>>("Delay reference", SECONDS, [](reference::Delay<11025>& delay, const float* input, int n) {
+		for (int i = 0; i < n; ++i) {
+			sink = sink + delay.process(input[i], .3f, .5f, 1.f, 1.f).left;
+		}
+	});
+	measure_decay<Delay<11025>>("Delay, flushing", SECONDS, [](Delay<11025>& delay, const float* input, int n) {
+		for (int i = 0; i < n; ++i) {
+			sink = sink + delay.process(input[i], .3f, .5f, 1.f, 1.f).left;
+		}
+	});
+}
+
+// direct-form convolution, for comparison with Convolver
+class DirectConvolver {
+	std::vector<float> left; // reversed
+	std::vector<float> right;
+	std::vector<float> history; // mirrored like in DelayLine
+	std::size_t position = 0;
+public:
+	DirectConvolver(const std::vector<float>& left, const std::vector<float>& right): left(left.rbegin(), left.rend()), right(right.rbegin(), right.rend()), history(2 * left.size()) {}
+	Sample process(float input) {
+		const std::size_t size = left.size();
+		history[position] = input;
+		history[position + size] = input;
+		position = position + 1 == size ? 0 : position + 1;
+		const float* window = &history[position];
+		float sum_left = 0.f;
+		float sum_right = 0.f;
+		for (std::size_t i = 0; i < size; ++i) {
+			sum_left += window[i] * left[i];
+			sum_right += window[i] * right[i];
+		}
+		return Sample(sum_left, sum_right);
+	}
+};
+
+// exponentially decaying noise, like the impulse response of a room
+std::vector<float> room_response(float seconds, uint64_t seed) {
+	std::vector<float> response(seconds * 44100);
+	for (std::size_t i = 0; i < response.size(); ++i) {
+		response[i] = (splitmix64(seed) >> 40) * (2.f / (1 << 24)) - 1.f;
+		response[i] *= .1f * std::exp(-7.f * i / response.size());
+	}
+	return response;
+}
+
+void benchmark_convolver() {
+	std::vector<float> input(44100 * 5);
+	Noise().process_block(input.data(), input.size());
+	float wet[BLOCK_SIZE];
+	float dry[BLOCK_SIZE];
+	std::fill_n(wet, BLOCK_SIZE, 1.f);
+	std::fill_n(dry, BLOCK_SIZE, 0.f);
+	for (float seconds: {.5f, 3.f}) {
+		const std::vector<float> left = room_response(seconds, 1);
+		const std::vector<float> right = room_response(seconds, 2);
+		// direct convolution only for a short while, it is far from realtime
+		const int direct_frames = 44100 / 20;
+		std::vector<Sample> direct_output(direct_frames);
+		DirectConvolver direct(left, right);
+		const double direct_time = measure([&]() {
+			for (int i = 0; i < direct_frames; ++i) {
+				direct_output[i] = direct.process(input[i]);
+			}
+		}, 1) / direct_frames;
+		printf("%.1f s stereo impulse response, direct:       %9.2f ns/sample (%.2fx realtime)\n", seconds, direct_time * 1e9, DT / direct_time);
+		for (std::size_t max_partition: {std::size_t(BLOCK_SIZE), std::size_t(4096)}) {
+			std::vector<Sample> output(input.size());
+			double time = INFINITY;
+			for (int run = 0; run < 3; ++run) {
+				Convolver convolver(left, right, max_partition);
+				time = std::min(time, measure([&]() {
+					for (std::size_t i = 0; i < input.size(); i += BLOCK_SIZE) {
+						convolver.process_block(input.data() + i, wet, dry, output.data() + i, std::min<std::size_t>(BLOCK_SIZE, input.size() - i));
+					}
+				}, 1) / input.size());
+			}
+			float difference = 0.f;
+			for (int i = 0; i < direct_frames; ++i) {
+				difference = std::max({difference, std::abs(output[i].left - direct_output[i].left), std::abs(output[i].right - direct_output[i].right)});
+			}
+			printf("%.1f s stereo impulse response, %s %9.2f ns/sample (%.0fx realtime, max difference %g)\n", seconds, max_partition == BLOCK_SIZE ? "uniform:     " : "non-uniform: ", time * 1e9, DT / time, difference);
+		}
+	}
+}
+
+// the power of everything but the harmonics of frequency relative to the harmonics, in dB
+double aliasing(const std::vector<float>& signal, float frequency) {
+	const int N = 16384;
+	std::vector<float> real(N), imag(N);
+	for (int i = 0; i < N; ++i) {
+		// 4-term Blackman-Harris, whose sidelobes stay below -92 dB
+		const float window = .35875f - .48829f * std::cos(2.f * PI * i / N) + .14128f * std::cos(4.f * PI * i / N) - .01168f * std::cos(6.f * PI * i / N);
+		real[i] = signal[signal.size() - N + i] * window;
+	}
+	FFT(N).forward(real.data(), imag.data());
+	const float resolution = 44100.f / N;
+	double harmonics = 0., rest = 0.;
+	for (int k = 1; k < N / 2; ++k) {
+		const float harmonic = std::round(k * resolution / frequency);
+		const bool near_harmonic = harmonic >= 1.f && std::abs(k * resolution - harmonic * frequency) < 6.f * resolution;
+		(near_harmonic ? harmonics : rest) += real[k] * real[k] + imag[k] * imag[k];
+	}
+	return 10. * std::log10(rest / harmonics);
+}
+
+class Overdrive {
+public:
+	static float process(float input) {
+		return Clip::process(4.f * input);
+	}
+};
+
+// renders a second of T block by block and prints its aliasing and speed
+template <class T> void measure_aliasing(const char* name, const char* variant, float frequency, const std::vector<float>& input) {
+	std::vector<float> output(input.size());
+	double time = INFINITY;
+	for (int run = 0; run < 3; ++run) {
+		T processor;
+		time = std::min(time, measure([&]() {
+			for (std::size_t i = 0; i < output.size(); i += BLOCK_SIZE) {
+				NodeInfo::process_block(processor, output.data() + i, std::min<int>(BLOCK_SIZE, output.size() - i), input.data() + i);
+			}
+		}, 1) / output.size());
+	}
+	printf("%-24s %-10s aliasing %6.1f dB, %6.2f ns/sample\n", name, variant, aliasing(output, frequency), time * 1e9);
+}
+
+#ifndef MODO_SAMPLE_RATE
+template <class T> void compare_factors(const char* name, float frequency, const std::vector<float>& input) {
+	measure_aliasing<T>(name, "1x:", frequency, input);
+	measure_aliasing<Oversampled<T, 2>>(name, "2x:", frequency, input);
+	measure_aliasing<Oversampled<T, 4>>(name, "4x:", frequency, input);
+	measure_aliasing<Oversampled<T, 8>>(name, "8x:", frequency, input);
+}
+
+void benchmark_oversampling() {
+	std::vector<float> frequency(44100, 3000.f);
+	compare_factors<Saw>("Saw at 3 kHz", 3000.f, frequency);
+	std::vector<float> sine(44100);
+	for (std::size_t i = 0; i < sine.size(); ++i) {
+		sine[i] = std::sin(2.f * PI * 3000.f * i / 44100.f);
+	}
+	compare_factors<Overdrive>("clipped sine at 3 kHz", 3000.f, sine);
+}
+#endif
+
+class WavetableSquare: public WavetableOsc {
+public:
+	WavetableSquare(): WavetableOsc(Wavetable::square()) {}
+};
+
+template <std::size_t N, class T> double render_voices(T& oscillator, int frames) {
+	Vector<float, N> frequency;
+	for (std::size_t i = 0; i < N; ++i) {
+		frequency[i] = 110.f * (i + 1);
+	}
+	return measure([&]() {
+		Vector<float, N> sum = {};
+		for (int i = 0; i < frames; ++i) {
+			sum += oscillator.process(frequency);
+		}
+		sink = sink + sum[0];
+	}) / frames / N;
+}
+
+void benchmark_wavetables() {
+	const auto start = std::chrono::steady_clock::now();
+	Wavetable::saw();
+	printf("building the saw tables: %.2f ms\n", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e3);
+	for (float frequency: {55.f, 440.f, 3000.f, 5000.f}) {
+		char name[32];
+		snprintf(name, sizeof(name), "Saw at %g Hz", frequency);
+		const std::vector<float> input(44100, frequency);
+		measure_aliasing<Saw>(name, "naive:", frequency, input);
+#ifndef MODO_SAMPLE_RATE
+		measure_aliasing<Oversampled<Saw, 4>>(name, "4x:", frequency, input);
+#endif
+		measure_aliasing<WavetableOsc>(name, "wavetable:", frequency, input);
+	}
+	const std::vector<float> input(44100, 3000.f);
+	measure_aliasing<Square>("Square at 3000 Hz", "naive:", 3000.f, input);
+	measure_aliasing<WavetableSquare>("Square at 3000 Hz", "wavetable:", 3000.f, input);
+	PolySaw<VOICES> saw;
+	PolyWavetableOsc<VOICES> wavetable;
+	printf("%zu voices, PolySaw:          %6.2f ns/sample per voice\n", VOICES, render_voices<VOICES>(saw, 44100) * 1e9);
+	printf("%zu voices, PolyWavetableOsc: %6.2f ns/sample per voice\n", VOICES, render_voices<VOICES>(wavetable, 44100) * 1e9);
+}
+
+// the drum arrangement with a bass line whose filter is swept by a control-rate automation, and a convolution room
+struct Song {
+	Arrangement<Asleep> drums;
+	Node2<WavetableOsc> bass;
+	Node2<Automation> sweep{"0 .3/20 .02/20 .3/20"};
+	ControlRate<float> cutoff;
+	Node2<LowPass> filter;
+	Node2<Pan> pan;
+	Node2<Mono> mono;
+	Node2<Convolver> room;
+	ThreadPool pool{1};
+	ParallelMix mix{pool};
+	Song(const std::vector<std::string>& patterns): drums(patterns), room(room_response(.5f, 1), room_response(.5f, 2)) {
+		bass.connect(55.f);
+		cutoff.connect(sweep);
+		filter.connect(bass, cutoff);
+		pan.connect(filter, 0.f);
+		mono.connect(drums.reverb);
+		room.connect(mono, .3f, 1.f);
+		mix.add(room);
+		mix.add(pan);
+	}
+};
+
+void benchmark_checkpoints() {
+	const std::vector<std::string> patterns = {
+		"8       8       8       8   8   ",
+		"    8       8       8       8   ",
+		"  4   4   4   4   4   4   4   4 ",
+		"8           8           8       "
+	};
+	const int frames = 60 * 44100;
+	auto render = [](Output<Sample>& output, int start, int end, Sample* samples, Checkpoints* checkpoints) {
+		for (int t = start; t < end; t += BLOCK_SIZE) {
+			if (checkpoints) {
+				checkpoints->update(output, t);
+			}
+			output.get_block(t, samples + (t - start), std::min(BLOCK_SIZE, end - t));
+		}
+	};
+	std::vector<Sample> reference(frames);
+	double plain = INFINITY;
+	double checkpointed = INFINITY;
+	std::unique_ptr<Song> song;
+	Checkpoints checkpoints(10.f);
+	for (int run = 0; run < 3; ++run) {
+		std::unique_ptr<Song> plain_song(new Song(patterns));
+		plain = std::min(plain, measure([&]() {
+			render(plain_song->mix, 1, 1 + frames, reference.data(), nullptr);
+		}, 1));
+		song.reset(new Song(patterns));
+		checkpoints = Checkpoints(10.f);
+		checkpointed = std::min(checkpointed, measure([&]() {
+			render(song->mix, 1, 1 + frames, reference.data(), &checkpoints);
+		}, 1));
+	}
+	printf("60 s song:                 %.0f ms, with a checkpoint every 10 s %.0f ms (%zu states, %.1f MB)\n", plain * 1e3, checkpointed * 1e3, checkpoints.get_count(), checkpoints.get_size() / 1e6);
+	// the 4 seconds from 47 s, once from the beginning and once from the checkpoint at 40 s, at a block start
+	const int start = 1 + 47 * 44100 / BLOCK_SIZE * BLOCK_SIZE;
+	const int length = 4 * 44100;
+	std::vector<Sample> section(length);
+	std::vector<Sample> skipped(start);
+	std::unique_ptr<Song> fresh(new Song(patterns));
+	const double from_beginning = measure([&]() {
+		render(fresh->mix, 1, start, skipped.data(), nullptr);
+		render(fresh->mix, start, start + length, section.data(), nullptr);
+	}, 1);
+	bool restored = false;
+	const double from_checkpoint = measure([&]() {
+		restored = checkpoints.restore(song->mix, start);
+		render(song->mix, start, start + length, section.data(), nullptr);
+	}, 1);
+	float difference = 0.f;
+	for (int i = 0; i < length; ++i) {
+		const Sample& expected = reference[start - 1 + i];
+		difference = std::max({difference, std::abs(section[i].left - expected.left), std::abs(section[i].right - expected.right)});
+	}
+	printf("4 s from 47 s:             %.0f ms from the beginning, %.0f ms from a checkpoint (%s, max difference %g)\n", from_beginning * 1e3, from_checkpoint * 1e3, restored ? "restored" : "not restored", difference);
+}
+
+int main() {
+	benchmark_freeverb();
+	benchmark_chain();
+	benchmark_voices();
+	benchmark_automation();
+	benchmark_noise();
+	benchmark_delay();
+	benchmark_control_rate();
+#ifndef MODO_SAMPLE_RATE
+	benchmark_sample_rate();
+#endif
+	benchmark_fast_math();
+	benchmark_sleeping();
+	benchmark_denormals();
+	benchmark_convolver();
+#ifndef MODO_SAMPLE_RATE
+	benchmark_oversampling();
+#endif
+	benchmark_wavetables();
+	benchmark_checkpoints();
+}
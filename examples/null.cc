@@ -0,0 +1,131 @@
+// plays to ALSA's null device, which takes the audio as fast as it is written, with each ALSAOutput setting and
+// checks what was rendered and the statistics, returns 1 if any check fails
+#include "../alsa.hh"
+#include <cstdio>
+
+using namespace modo;
+
+int failures = 0;
+
+void check(const char* name, bool passed) {
+	printf("%-64s %s\n", name, passed ? "ok" : "FAILED");
+	failures += !passed;
+}
+
+// an oscillator panned to the left, recording every sample it renders by its frame
+// with a delay it takes that long for every block, to render slower than the device plays
+class Recorder: public Output<Sample> {
+	Node2<Osc> osc;
+	Node2<Pan> pan;
+	std::chrono::microseconds delay;
+public:
+	std::vector<Sample> samples;
+	long blocks = 0;
+	Recorder(long frames, std::chrono::microseconds delay = std::chrono::microseconds(0)): delay(delay), samples(frames) {
+		osc.connect(440.f);
+		pan.connect(osc, -.5f);
+	}
+	Sample get(int t) override {
+		Sample sample;
+		get_block(t, &sample, 1);
+		return sample;
+	}
+	void get_block(int t, Sample* buffer, int n) override {
+		std::this_thread::sleep_for(delay);
+		pan.get_block(t, buffer, n);
+		std::copy_n(buffer, n, samples.begin() + (t - 1));
+		++blocks;
+	}
+};
+
+bool equal(const std::vector<Sample>& a, const std::vector<Sample>& b) {
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const Sample& x, const Sample& y) {
+		return x.left == y.left && x.right == y.right;
+	});
+}
+
+// the samples the graph renders when nothing plays them
+std::vector<Sample> render_reference(long frames) {
+	Recorder recorder(frames);
+	Sample buffer[BLOCK_SIZE];
+	for (long t = 0; t < frames; t += BLOCK_SIZE) {
+		recorder.get_block(1 + t, buffer, std::min<long>(BLOCK_SIZE, frames - t));
+	}
+	return recorder.samples;
+}
+
+void test_settings(const char* name, bool mmap, bool float_format) {
+	const long frames = 10 * 512 + 100;
+	ALSAOutput::Settings settings;
+	settings.device = "null";
+	settings.mmap = mmap;
+	settings.float_format = float_format;
+	ALSAOutput output(settings);
+	Recorder recorder(frames);
+	output.run(recorder, frames);
+	char description[64];
+	snprintf(description, sizeof(description), "%s: renders every frame once", name);
+	check(description, equal(recorder.samples, render_reference(frames)));
+	snprintf(description, sizeof(description), "%s: plays every period", name);
+	check(description, output.statistics.periods == 11 && output.statistics.xruns == 0);
+	// the null device consumes everything once it runs, so there is no headroom left
+	snprintf(description, sizeof(description), "%s: starts the device", name);
+	check(description, output.statistics.worst_headroom == 0);
+	printf("  render time %ld us, worst %ld us\n", output.statistics.render_time.load(), output.statistics.worst_render_time.load());
+}
+
+// plays through the file device, which writes everything to a file and passes it on to the null device, and
+// returns what was written
+std::vector<char> play(ALSAOutput::Settings settings, Recorder& recorder, long frames, ALSAOutput::Statistics* statistics = nullptr) {
+	const char* path = "null.raw";
+	const std::string device = std::string("file:FILE=") + path + ",FORMAT=raw";
+	settings.device = device.c_str();
+	ALSAOutput output(settings);
+	output.run(recorder, frames);
+	if (statistics) {
+		statistics->periods = output.statistics.periods.load();
+		statistics->starved = output.statistics.starved.load();
+		statistics->lowest_fill = output.statistics.lowest_fill.load();
+	}
+	std::vector<char> data;
+	if (FILE* file = fopen(path, "rb")) {
+		char buffer[4096];
+		std::size_t size;
+		while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+			data.insert(data.end(), buffer, buffer + size);
+		}
+		fclose(file);
+	}
+	remove(path);
+	return data;
+}
+
+void test_pipelined(bool mmap) {
+	const long frames = 10 * 512 + 100;
+	ALSAOutput::Settings settings;
+	settings.mmap = mmap;
+	Recorder direct(frames);
+	const std::vector<char> expected = play(settings, direct, frames);
+	settings.lookahead = 4;
+	Recorder pipelined(frames);
+	ALSAOutput::Statistics statistics;
+	const std::vector<char> played = play(settings, pipelined, frames, &statistics);
+	check(mmap ? "mmap with lookahead: plays the same as without" : "write with lookahead: plays the same as without", expected.size() == frames * 4 && played == expected);
+	check(mmap ? "mmap with lookahead: renders every block once" : "write with lookahead: renders every block once", equal(pipelined.samples, render_reference(frames)) && pipelined.blocks == (frames + BLOCK_SIZE - 1) / BLOCK_SIZE);
+	// each block takes 2 ms to render but only plays for 1.5 ms, so the device has to wait for it
+	Recorder slow(frames, std::chrono::microseconds(2000));
+	const auto start = std::chrono::steady_clock::now();
+	const std::vector<char> behind = play(settings, slow, frames, &statistics);
+	const float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	check(mmap ? "mmap with lookahead: plays the same when rendering falls behind" : "write with lookahead: plays the same when rendering falls behind", behind == expected && statistics.periods == 11);
+	check(mmap ? "mmap with lookahead: runs out of blocks and still stops" : "write with lookahead: runs out of blocks and still stops", statistics.starved > 0 && seconds < 1.f);
+}
+
+int main() {
+	test_settings("write", false, false);
+	test_settings("mmap", true, false);
+	test_settings("mmap, float", true, true);
+	test_pipelined(false);
+	test_pipelined(true);
+	return failures > 0;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "../modo.hh"
+
+using namespace modo;
+
+namespace reference {
+
+// the original automation that parses its string while rendering, kept to check the compiled one against
+class Automation {
+	const char* automation;
+	const char* cursor;
+	float value;
+	float delta;
+	int t;
+	float parse_number() {
+		float number = 0.f;
+		float sign = 1.f;
+		if (*cursor == '-') {
+			sign = -1.f;
+			++cursor;
+		}
+		while (*cursor >= '0' && *cursor <= '9') {
+			number = (number * 10.f) + (*cursor - '0');
+			++cursor;
+		}
+		if (*cursor == '.') {
+			++cursor;
+			float factor = .1f;
+			while (*cursor >= '0' && *cursor <= '9') {
+				number += (*cursor - '0') * factor;
+				factor /= 10.f;
+				++cursor;
+			}
+		}
+		return number * sign;
+	}
+	void skip_space() {
+		while (*cursor == ' ') {
+			++cursor;
+		}
+	}
+public:
+	Automation(const char* automation): automation(automation), cursor(automation), value(0.f), delta(0.f), t(1) {}
+	float process() {
+		value += delta;
+		--t;
+		if (t == 0) {
+			if (*cursor != '\0') {
+				const float new_value = parse_number();
+				if (*cursor == '/') {
+					++cursor;
+					t = parse_number() / DT;
+					delta = (new_value - value) / t;
+				}
+				else {
+					value = new_value;
+					delta = 0.f;
+					t = 1;
+				}
+				skip_space();
+			}
+			else {
+				delta = 0.f;
+			}
+		}
+		return value;
+	}
+	void reset() {
+		cursor = automation;
+		value = 0.f;
+		delta = 0.f;
+		t = 1;
+	}
+};
+
+} // namespace reference
@@ -0,0 +1,205 @@
+// times every processor on its own and whole graphs, and writes the results as JSON to the file given as argument
+#include "../modo.hh"
+#include "../leslie.hh"
+#include "kick.hh"
+#include "snare.hh"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+using namespace modo;
+
+const int FRAMES = 2 * get_sample_rate();
+
+struct Result {
+	std::string name;
+	double ns_per_sample;
+	double realtime_factor;
+};
+std::vector<Result> results;
+
+// returns the fastest of several runs in seconds
+template <class F> double measure(F&& f, int runs = 5) {
+	double best = INFINITY;
+	for (int run = 0; run < runs; ++run) {
+		const auto start = std::chrono::steady_clock::now();
+		f();
+		best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+void report(const char* name, double seconds) {
+	const double ns_per_sample = seconds * 1e9 / FRAMES;
+	const double realtime_factor = FRAMES / get_sample_rate() / seconds;
+	results.push_back({name, ns_per_sample, realtime_factor});
+	printf("%-24s %9.2f ns/sample %9.0fx realtime\n", name, ns_per_sample, realtime_factor);
+}
+
+// times a processor block by block over precomputed inputs, the way Node2 runs it
+template <class T, class... Arg> void benchmark_processor(const char* name, T processor, const std::vector<Arg>&... inputs) {
+	std::vector<NodeInfo::return_type<T>> output(FRAMES);
+	report(name, measure([&]() {
+		for (int t = 0; t < FRAMES; t += BLOCK_SIZE) {
+			NodeInfo::process_block(processor, output.data() + t, std::min(BLOCK_SIZE, FRAMES - t), inputs.data() + t...);
+		}
+	}));
+}
+
+// times a graph by pulling blocks from its output
+template <class T> void benchmark_graph(const char* name, Output<T>& output) {
+	T buffer[BLOCK_SIZE];
+	report(name, measure([&]() {
+		for (int t = 1; t <= FRAMES; t += BLOCK_SIZE) {
+			output.get_block(t, buffer, std::min(BLOCK_SIZE, FRAMES - t + 1));
+		}
+	}));
+}
+
+template <class T> std::vector<T> constant(T value) {
+	return std::vector<T>(FRAMES, value);
+}
+
+void benchmark_processors() {
+	std::vector<float> noise(FRAMES);
+	Noise().process_block(noise.data(), FRAMES);
+	// MIDI clock at 120 bpm and the events of a drum pattern
+	std::vector<MIDIEvent> clock(FRAMES);
+	std::vector<MIDIEvent> events(FRAMES);
+	MIDIClock midi_clock;
+	Pattern<2> pattern({NotePattern(36, "8 4 8 4 "), NotePattern(38, "  8   8 ")});
+	for (int i = 0; i < FRAMES; ++i) {
+		clock[i] = midi_clock.process(120.f);
+		events[i] = pattern.process(clock[i]);
+	}
+	benchmark_processor("Osc", Osc(), constant(440.f));
+	benchmark_processor("Saw", Saw(), constant(440.f));
+	benchmark_processor("Square", Square(), constant(440.f));
+#ifndef MODO_SAMPLE_RATE
+	benchmark_processor("Oversampled<Saw, 4>", Oversampled<Saw, 4>(), constant(440.f));
+#endif
+	benchmark_processor("WavetableOsc", WavetableOsc(), constant(440.f));
+	benchmark_processor("Noise", Noise());
+	benchmark_processor("LowPass", LowPass(), noise, constant(.1f));
+	benchmark_processor("Resonator", Resonator(), noise, constant(.1f), constant(.3f));
+	benchmark_processor("Delay", Delay<11025>(), noise, constant(.5f), constant(.5f), constant(1.f), constant(.5f));
+	benchmark_processor("Freeverb", Freeverb(), noise, constant(.8f), constant(.5f), constant(.3f), constant(.7f), constant(1.f));
+	benchmark_processor("Leslie", Leslie(), noise, constant(30.f));
+	// a second of decaying noise as impulse response
+	std::vector<float> response(get_sample_rate());
+	for (std::size_t i = 0; i < response.size(); ++i) {
+		response[i] = noise[i] * .1f * std::exp(-7.f * i / response.size());
+	}
+	benchmark_processor("Convolver", Convolver(response, response), noise, constant(1.f), constant(0.f));
+	benchmark_processor("ADSR", ADSR(), events, constant(10.f), constant(200.f), constant(.5f), constant(300.f));
+	benchmark_processor("Automation", Automation("0 1/.5 .2^.5 .8/.5 0^.5"));
+	benchmark_processor("Pattern", Pattern<2>({NotePattern(36, "8 4 8 4 "), NotePattern(38, "  8   8 ")}), clock);
+}
+
+class Add {
+public:
+	static float process(float a, float b) {
+		return a + b;
+	}
+};
+class Multiply {
+public:
+	static float process(float a, float b) {
+		return a * b;
+	}
+};
+
+// 20 voices of 4 nodes each, summed by a tree of 19 Add nodes and panned: 100 nodes
+class SyntheticGraph {
+	struct Voice {
+		Node2<Saw> saw;
+		Node2<LowPass> low_pass;
+		Node2<Automation> envelope{"0 1/.01 .5^.3 0^1.5"};
+		Node2<Multiply> amplifier;
+	};
+	std::vector<std::unique_ptr<Voice>> voices;
+	std::vector<std::unique_ptr<Node2<Add>>> sums;
+public:
+	Node2<Pan> pan;
+	SyntheticGraph() {
+		std::vector<Output<float>*> outputs;
+		for (int i = 0; i < 20; ++i) {
+			voices.emplace_back(new Voice());
+			Voice& voice = *voices.back();
+			voice.saw.connect(55.f * (i + 1));
+			voice.low_pass.connect(voice.saw, .2f);
+			voice.amplifier.connect(voice.low_pass, voice.envelope);
+			outputs.push_back(&voice.amplifier);
+		}
+		while (outputs.size() > 1) {
+			std::vector<Output<float>*> next;
+			for (std::size_t i = 0; i + 1 < outputs.size(); i += 2) {
+				sums.emplace_back(new Node2<Add>());
+				sums.back()->connect(*outputs[i], *outputs[i + 1]);
+				next.push_back(sums.back().get());
+			}
+			if (outputs.size() % 2 == 1) {
+				next.push_back(outputs.back());
+			}
+			outputs = next;
+		}
+		pan.connect(*outputs[0], 0.f);
+	}
+};
+
+// a kick on every beat from a Sequencer, through OneEventPerFrame into an ADSR that gates a sine
+struct SequencedKick {
+	Node2<Sequencer> sequencer{NotePattern(36, "8   8   8   8   ")};
+	Node2<OneEventPerFrame> events;
+	Node2<ADSR> envelope;
+	Node2<Osc> osc;
+	Node2<Amplifier> amplifier;
+	SequencedKick() {
+		sequencer.connect(120.f);
+		events.connect(sequencer);
+		envelope.connect(events, 1.f, 100.f, 0.f, 50.f);
+		osc.connect(55.f);
+		amplifier.connect(envelope, osc);
+	}
+};
+
+void benchmark_graphs() {
+	Node2<Kick> kick;
+	kick.set_name("kick");
+	benchmark_graph("kick.cc", kick);
+	Node2<Snare> snare;
+	snare.set_name("snare");
+	Node2<Pan> pan;
+	pan.connect(snare, 0.f);
+	benchmark_graph("snare.cc", pan);
+	SyntheticGraph graph;
+	benchmark_graph("100 node graph", graph.pan);
+	SequencedKick sequenced;
+	benchmark_graph("sequenced kick", sequenced.amplifier);
+#ifdef MODO_PROFILE
+	printf("\n%s", Profile::report().c_str());
+#endif
+}
+
+void write_json(const char* path) {
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		fprintf(stderr, "could not open %s\n", path);
+		return;
+	}
+	fprintf(file, "{\n\t\"sample_rate\": %g,\n\t\"block_size\": %d,\n\t\"frames\": %d,\n\t\"results\": [\n", get_sample_rate(), BLOCK_SIZE, FRAMES);
+	for (std::size_t i = 0; i < results.size(); ++i) {
+		fprintf(file, "\t\t{\"name\": \"%s\", \"ns_per_sample\": %.3f, \"realtime_factor\": %.1f}%s\n", results[i].name.c_str(), results[i].ns_per_sample, results[i].realtime_factor, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+	fclose(file);
+}
+
+int main(int argc, char** argv) {
+	benchmark_processors();
+	benchmark_graphs();
+	if (argc > 1) {
+		write_json(argv[1]);
+	}
+}
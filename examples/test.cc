@@ -0,0 +1,607 @@
+// checks the processors and graphs against simpler reference computations, returns 1 if any check fails
+#include "../modo.hh"
+#include "../thread.hh"
+#include "reference.hh"
+#include <cstdio>
+
+using namespace modo;
+
+int failures = 0;
+
+void check(const char* name, bool passed) {
+	printf("%-64s %s\n", name, passed ? "ok" : "FAILED");
+	failures += !passed;
+}
+
+bool equal(const std::vector<float>& a, const std::vector<float>& b) {
+	return a == b;
+}
+bool equal(const std::vector<Sample>& a, const std::vector<Sample>& b) {
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const Sample& x, const Sample& y) {
+		return x.left == y.left && x.right == y.right;
+	});
+}
+
+std::vector<char> read_file(const char* file_name) {
+	std::ifstream file(file_name, std::ios_base::binary);
+	return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// counts the samples it has processed, so that a frame processed twice or skipped shows in its output
+class Counter {
+	float count = 0.f;
+public:
+	float process() {
+		return count++;
+	}
+};
+
+class Add {
+public:
+	static float process(float a, float b) {
+		return a + b;
+	}
+};
+
+// a Saw that feeds both a Gain and an adder, which adds the Gain back to it
+struct SawTwice {
+	Node2<Saw> saw;
+	Gain gain;
+	Node2<Add> add;
+	SawTwice() {
+		saw.connect(440.f);
+		saw >> gain.input;
+		1.f >> gain.amount;
+		add.connect(saw, gain);
+	}
+};
+
+void test_caches() {
+	const int frames = 1000;
+	std::vector<float> expected(frames);
+	Saw saw;
+	for (float& sample: expected) {
+		sample = 2.f * saw.process(440.f);
+	}
+	std::vector<float> by_blocks(frames);
+	SawTwice blocks;
+	for (int t = 0; t < frames; t += BLOCK_SIZE) {
+		blocks.add.get_block(1 + t, by_blocks.data() + t, std::min(BLOCK_SIZE, frames - t));
+	}
+	check("a Saw into a Gain and an adder, by blocks", equal(by_blocks, expected));
+	std::vector<float> by_samples(frames);
+	SawTwice samples;
+	for (int t = 0; t < frames; ++t) {
+		by_samples[t] = samples.add.get(1 + t);
+	}
+	check("a Saw into a Gain and an adder, by samples", equal(by_samples, expected));
+	// the Gain pulled by samples and the adder by blocks
+	std::vector<float> mixed(frames);
+	SawTwice both;
+	for (int t = 0; t < frames; t += BLOCK_SIZE) {
+		const int n = std::min(BLOCK_SIZE, frames - t);
+		for (int i = 0; i < n; ++i) {
+			both.gain.get(1 + t + i);
+		}
+		both.add.get_block(1 + t, mixed.data() + t, n);
+	}
+	check("a Saw into a Gain and an adder, by samples and blocks", equal(mixed, expected));
+	// blocks that overlap the cached samples and end past BLOCK_SIZE of them
+	Node2<Counter> counter;
+	std::vector<float> counts(2 * BLOCK_SIZE);
+	counter.get_block(1, counts.data(), 40);
+	counter.get_block(21, counts.data() + 20, BLOCK_SIZE);
+	counter.get_block(61, counts.data() + 60, BLOCK_SIZE);
+	bool once = true;
+	for (int i = 0; i < 60 + BLOCK_SIZE; ++i) {
+		once = once && counts[i] == i;
+	}
+	check("overlapping blocks process every frame once", once);
+}
+
+// an Automation evaluated by samples stays within rounding of the same Automation evaluated by blocks
+void test_automation() {
+	const char* automation = "0 1/.01 .5^.02 .5/.005 -1/.03 0^.05";
+	for (int stride: {1, 4}) {
+		Automation by_samples(automation, stride);
+		Automation by_blocks(automation, stride);
+		float difference = 0.f;
+		for (int t = 0; t < 10000; t += BLOCK_SIZE) {
+			float block[BLOCK_SIZE];
+			by_blocks.process_block(block, BLOCK_SIZE);
+			for (int i = 0; i < BLOCK_SIZE; ++i) {
+				difference = std::max(difference, std::abs(by_samples.process() - block[i]));
+			}
+		}
+		check(stride == 1 ? "Automation by samples matches it by blocks" : "Automation by samples matches it by blocks, with a stride", difference < 1e-4f);
+	}
+}
+
+struct Played {
+	long frame;
+	MIDIEvent event;
+};
+
+// 120 bpm, a ramp from 97 bpm after 4 s and 173 bpm after 8 s
+float get_tempo(long frame) {
+	const long change = 4 * 44100;
+	return frame < change ? 120.f : (frame < 2 * change ? 97.3f + (frame - change) * 1e-4f : 173.f);
+}
+
+// the tempo of get_tempo as an output, frames start at 1
+class Tempo: public Output<float> {
+public:
+	float get(int t) override {
+		return get_tempo(t - 1);
+	}
+};
+
+bool same_timeline(const std::vector<Played>& a, const std::vector<Played>& b, long tolerance) {
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [&](const Played& x, const Played& y) {
+		return std::abs(x.frame - y.frame) <= tolerance && x.event.status == y.event.status && x.event.data1 == y.event.data1 && x.event.data2 == y.event.data2;
+	});
+}
+
+// the compiled Automation ends every ramp on its target, where the original parser ends it wherever adding up its
+// steps got to, so they differ by the rounding of one ramp: about 1e-4 of the range, .007 Hz on the 45 Hz of the Kick
+// (which shifts the phase of its Osc, a render of kick.cc changes by up to 75 steps of 16 bits)
+void test_automation_against_parser() {
+	const char* automations[] = {
+		"130 45/.1",
+		"0 .9/.01 .3/.2 0/.4",
+		"3000 3000/.0005 500/.002 150/.01 50/.1",
+		"0 .8/.0002 .8/.2 0/.1",
+		"4000 4000/.001 400/.002 200/.01",
+		"0 1.3/.0002 .15/.05 0/.05",
+		"0 .9/.03 .05/.05 0/.1"
+	};
+	float by_samples = 0.f;
+	float by_blocks = 0.f;
+	for (const char* automation: automations) {
+		reference::Automation parsed(automation);
+		Automation samples(automation);
+		Automation blocks(automation);
+		std::vector<float> expected(44100);
+		float range = 0.f;
+		for (float& value: expected) {
+			value = parsed.process();
+			range = std::max(range, std::abs(value));
+		}
+		for (int t = 0; t < 44100; t += BLOCK_SIZE) {
+			float block[BLOCK_SIZE];
+			const int n = std::min(BLOCK_SIZE, 44100 - t);
+			blocks.process_block(block, n);
+			for (int i = 0; i < n; ++i) {
+				by_samples = std::max(by_samples, std::abs(samples.process() - expected[t + i]) / range);
+				by_blocks = std::max(by_blocks, std::abs(block[i] - expected[t + i]) / range);
+			}
+		}
+	}
+	check("Automation by samples stays within 2e-4 of the original parser", by_samples < 2e-4f);
+	check("Automation by blocks stays within 2e-4 of the original parser", by_blocks < 2e-4f);
+}
+
+// the frames it was asked for, returned as they are
+class Frames: public Output<float> {
+public:
+	std::vector<int> asked;
+	float get(int t) override {
+		asked.push_back(t);
+		return t;
+	}
+};
+
+// a ControlRate asks for the ticks from frame 1 on, one tick ahead, and interpolates a ramp exactly
+void test_control_rate() {
+	constexpr int K = 16;
+	Frames frames;
+	ControlRate<float, K> control;
+	control.connect(frames);
+	bool exact = true;
+	bool ahead = true;
+	for (int t = 1; t <= 1000; t += BLOCK_SIZE) {
+		float block[BLOCK_SIZE];
+		control.get_block(t, block, BLOCK_SIZE);
+		for (int i = 0; i < BLOCK_SIZE; ++i) {
+			exact = exact && block[i] == t + i;
+		}
+		for (int asked: frames.asked) {
+			ahead = ahead && (asked - 1) % K == 0 && asked <= t + BLOCK_SIZE - 1 + K;
+		}
+	}
+	check("a ControlRate interpolates a ramp exactly", exact);
+	check("a ControlRate asks for the ticks from frame 1, a tick ahead", ahead && frames.asked[0] == 1);
+}
+
+// an attack or a release of 0 ms is instant
+void test_envelopes() {
+	ADSR adsr;
+	const float attacked = adsr.process(MIDIEvent::create_note_on(60, 100, 0), 0.f, 100.f, .5f, 0.f);
+	const float released = adsr.process(MIDIEvent::create_note_off(60, 0, 0), 0.f, 100.f, .5f, 0.f);
+	check("an ADSR with an attack and a release of 0 ms", attacked == 1.f && released == 0.f);
+	PolyADSR<4> poly_adsr;
+	VoiceState<4> voices = {};
+	voices.gate[0] = -1;
+	voices.trigger[0] = -1;
+	const float poly_attacked = poly_adsr.process(voices, 0.f, 100.f, .5f, 0.f)[0];
+	voices.gate[0] = 0;
+	voices.trigger[0] = 0;
+	const float poly_released = poly_adsr.process(voices, 0.f, 100.f, .5f, 0.f)[0];
+	check("a PolyADSR with an attack and a release of 0 ms", poly_attacked == 1.f && poly_released == 0.f);
+}
+
+// a Pan that sleeps through a silent gap still pulls its automated panning, which picks up where it should
+void test_sleeping() {
+	const char* signal = "1 0/.1 0/.9 1/.001";
+	const char* panning = "-1 1/2";
+	Node2<Automation> signal_node{signal};
+	Node2<Automation> panning_node{panning};
+	Node2<Pan> pan;
+	pan.connect(signal_node, panning_node);
+	Automation signal_reference(signal);
+	Automation panning_reference(panning);
+	float difference = 0.f;
+	for (int t = 0; t < 72000; t += BLOCK_SIZE) {
+		Sample block[BLOCK_SIZE];
+		pan.get_block(1 + t, block, BLOCK_SIZE);
+		for (int i = 0; i < BLOCK_SIZE; ++i) {
+			const Sample expected = Pan::process(signal_reference.process(), panning_reference.process());
+			difference = std::max(difference, std::abs(block[i].left - expected.left));
+			difference = std::max(difference, std::abs(block[i].right - expected.right));
+		}
+	}
+	check("a sleeping Pan keeps its automated panning in time", difference < 1e-3f);
+}
+// the Sequencer plays what a Pattern clocked by a MIDIClock plays, also across tempo changes
+void test_sequencer() {
+	const long frames = 12 * 44100;
+	const std::array<NotePattern, 3> patterns = {NotePattern(36, "8   8 8 8   8 5 "), NotePattern(38, "    8       8  4"), NotePattern(42, "5-5 5 5 ")};
+	std::vector<Played> expected;
+	MIDIClock clock;
+	Pattern<3> pattern(patterns);
+	for (long frame = 0; frame < frames; ++frame) {
+		const MIDIEvent event = pattern.process(clock.process(get_tempo(frame)));
+		if (event) {
+			expected.push_back({frame, event});
+		}
+	}
+	std::vector<Played> by_samples;
+	Sequencer samples({patterns[0], patterns[1], patterns[2]});
+	for (long frame = 0; frame < frames; ++frame) {
+		for (MIDIEvent event: samples.process(get_tempo(frame))) {
+			by_samples.push_back({frame, event});
+		}
+	}
+	std::vector<Played> by_blocks;
+	Sequencer blocks({patterns[0], patterns[1], patterns[2]});
+	for (long frame = 0; frame < frames; frame += BLOCK_SIZE) {
+		float bpm[BLOCK_SIZE];
+		MIDIEvents events[BLOCK_SIZE];
+		for (int i = 0; i < BLOCK_SIZE; ++i) {
+			bpm[i] = get_tempo(frame + i);
+		}
+		blocks.process_block(bpm, events, BLOCK_SIZE);
+		for (int i = 0; i < BLOCK_SIZE; ++i) {
+			for (MIDIEvent event: events[i]) {
+				by_blocks.push_back({frame + i, event});
+			}
+		}
+	}
+	// the Pattern plays the events of one tick on consecutive frames, and by blocks the tempo is read once per block
+	check("the Sequencer plays the timeline of a MIDIClock and a Pattern", expected.size() > 200 && same_timeline(by_samples, expected, 3));
+	check("the Sequencer plays the same timeline by blocks", same_timeline(by_blocks, expected, BLOCK_SIZE + 3));
+	// an ADSR, which takes a MIDIEvent, plays the Sequencer through OneEventPerFrame
+	Tempo tempo;
+	Node2<Sequencer> sequencer{patterns[0], patterns[1], patterns[2]};
+	Node2<OneEventPerFrame> one_event;
+	Node2<ADSR> envelope;
+	sequencer.connect(tempo);
+	one_event.connect(sequencer);
+	envelope.connect(one_event, 1.f, 50.f, .5f, 20.f);
+	std::vector<Played> one_by_one;
+	float peak = 0.f;
+	for (long frame = 0; frame < frames; frame += BLOCK_SIZE) {
+		const int n = std::min<long>(BLOCK_SIZE, frames - frame);
+		float values[BLOCK_SIZE];
+		MIDIEvent events[BLOCK_SIZE];
+		envelope.get_block(1 + frame, values, n);
+		one_event.get_block(1 + frame, events, n);
+		for (int i = 0; i < n; ++i) {
+			peak = std::max(peak, values[i]);
+			if (events[i]) {
+				one_by_one.push_back({frame + i, events[i]});
+			}
+		}
+	}
+	check("an ADSR plays the Sequencer through OneEventPerFrame", peak == 1.f && same_timeline(one_by_one, expected, BLOCK_SIZE + 3));
+}
+
+// Noise without a seed differs from every other, with a seed it is reproducible
+void test_noise() {
+	auto render = [](Noise noise) {
+		std::vector<float> samples(1000);
+		noise.process_block(samples.data(), samples.size());
+		return samples;
+	};
+	check("every Noise without a seed plays its own noise", !equal(render(Noise()), render(Noise())));
+	check("a Noise with a seed plays the same noise every time", equal(render(Noise(7)), render(Noise(7))));
+}
+
+// three instruments, the first two share a Saw, which the first one reaches through a Gain
+struct Band {
+	Node2<Saw> saw;
+	Gain gain;
+	Node2<Pan> first;
+	Node2<Pan> second;
+	Node2<Osc> osc;
+	Node2<Pan> third;
+	Band() {
+		saw.connect(220.f);
+		saw >> gain.input;
+		.5f >> gain.amount;
+		first.connect(gain, -.5f);
+		second.connect(saw, .5f);
+		osc.connect(330.f);
+		third.connect(osc, 0.f);
+	}
+	std::vector<Output<Sample>*> get_outputs() {
+		return {&first, &second, &third};
+	}
+};
+
+// a node that doesn't report its input
+class Hidden: public Node<Sample> {
+public:
+	Input<Sample> input;
+	Sample produce() override {
+		return get(input);
+	}
+};
+
+void test_parallel_mix() {
+	const int frames = 10000;
+	std::vector<Sample> expected(frames);
+	Band serial;
+	for (int t = 0; t < frames; t += BLOCK_SIZE) {
+		const int n = std::min(BLOCK_SIZE, frames - t);
+		Sample buffer[BLOCK_SIZE];
+		for (Output<Sample>* output: serial.get_outputs()) {
+			output->get_block(1 + t, buffer, n);
+			for (int i = 0; i < n; ++i) {
+				expected[t + i] = expected[t + i] + buffer[i];
+			}
+		}
+	}
+	ThreadPool pool(4);
+	Band parallel;
+	ParallelMix mix(pool);
+	for (Output<Sample>* output: parallel.get_outputs()) {
+		mix.add(*output);
+	}
+	std::vector<Sample> mixed(frames);
+	for (int t = 0; t < frames; t += BLOCK_SIZE) {
+		mix.get_block(1 + t, mixed.data() + t, std::min(BLOCK_SIZE, frames - t));
+	}
+	check("ParallelMix matches a serial mix", equal(mixed, expected));
+	const std::vector<std::vector<std::size_t>> groups = group_independent(parallel.get_outputs());
+	check("outputs that share a node behind a Gain are grouped", groups.size() == 2 && groups[0].size() == 2);
+	Hidden hidden;
+	parallel.second >> hidden.input;
+	check("outputs with unknown inputs are grouped with all others", group_independent({&parallel.first, &hidden, &parallel.third}).size() == 1);
+	// inputs below the silence threshold still count
+	Value<Sample> loud(Sample(.5f));
+	Value<Sample> quiet(Sample(5e-7f));
+	Value<Sample> quieter(Sample(2e-7f));
+	ParallelMix quiet_mix(pool);
+	quiet_mix.add(quiet);
+	quiet_mix.add(quieter);
+	ParallelMix loud_mix(pool);
+	loud_mix.add(loud);
+	loud_mix.add(quiet);
+	Sample quiet_block[BLOCK_SIZE];
+	Sample loud_block[BLOCK_SIZE];
+	const bool quiet_silent = quiet_mix.get_block_silent(1, quiet_block, BLOCK_SIZE);
+	const bool loud_silent = loud_mix.get_block_silent(1, loud_block, BLOCK_SIZE);
+	const float quiet_sum = 5e-7f + 2e-7f;
+	const float loud_sum = .5f + 5e-7f;
+	check("ParallelMix sums silent inputs and reports a silent mix", quiet_silent && quiet_block[0].left == quiet_sum && quiet_block[BLOCK_SIZE - 1].right == quiet_sum);
+	check("ParallelMix sums silent inputs into a loud mix", !loud_silent && loud_block[0].left == loud_sum && loud_block[BLOCK_SIZE - 1].right == loud_sum);
+}
+
+// mixes of mixes on one pool, where the inner batches are started from within the outer one
+void test_nested_mix() {
+	const int frames = 2000;
+	std::vector<Sample> expected(frames);
+	Band serial;
+	for (int t = 0; t < frames; t += BLOCK_SIZE) {
+		const int n = std::min(BLOCK_SIZE, frames - t);
+		Sample buffer[BLOCK_SIZE];
+		for (Output<Sample>* output: serial.get_outputs()) {
+			output->get_block(1 + t, buffer, n);
+			for (int i = 0; i < n; ++i) {
+				expected[t + i] = expected[t + i] + buffer[i];
+			}
+		}
+	}
+	ThreadPool pool(4);
+	Band band;
+	ParallelMix shared(pool);
+	shared.add(band.first);
+	shared.add(band.second);
+	ParallelMix single(pool);
+	single.add(band.third);
+	ParallelMix mix(pool);
+	mix.add(shared);
+	mix.add(single);
+	std::vector<Sample> mixed(frames);
+	for (int t = 0; t < frames; t += BLOCK_SIZE) {
+		mix.get_block(1 + t, mixed.data() + t, std::min(BLOCK_SIZE, frames - t));
+	}
+	check("nested ParallelMixes on one pool match a serial mix", equal(mixed, expected));
+	{
+		ThreadPool one(1);
+		Band stems;
+		ParallelMix all(one);
+		for (Output<Sample>* output: stems.get_outputs()) {
+			all.add(*output);
+		}
+		StemRenderer renderer(one, "nested-master.wav");
+		renderer.add(all, "nested-stem.wav");
+		renderer.run(frames);
+	}
+	{
+		WAVOutput wav("nested-single.wav");
+		Band single_band;
+		ParallelMix all(pool);
+		for (Output<Sample>* output: single_band.get_outputs()) {
+			all.add(*output);
+		}
+		wav.run(all, frames);
+	}
+	const std::vector<char> stem = read_file("nested-stem.wav");
+	check("a StemRenderer renders a ParallelMix on its own pool", stem.size() == 44 + frames * 4 && stem == read_file("nested-single.wav"));
+	remove("nested-stem.wav");
+	remove("nested-master.wav");
+	remove("nested-single.wav");
+}
+
+// a clock that only moves when it is set, and a MIDI source that never receives anything, so that events are
+// added with explicit timestamps
+struct ManualClock {
+	using duration = std::chrono::nanoseconds;
+	using rep = duration::rep;
+	using period = duration::period;
+	using time_point = std::chrono::time_point<ManualClock>;
+	static constexpr bool is_steady = true;
+	static time_point time;
+	static time_point now() {
+		return time;
+	}
+};
+ManualClock::time_point ManualClock::time;
+
+class NoSource {
+public:
+	bool receive(MIDIEvent& event) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		return false;
+	}
+};
+
+ManualClock::time_point seconds(double time) {
+	return ManualClock::time_point(std::chrono::duration_cast<ManualClock::duration>(std::chrono::duration<double>(time)));
+}
+
+// a chord that arrives within a frame is played on one frame and the next note after its delay
+void test_midi_receiver() {
+	MIDIReceiver<NoSource, ManualClock> receiver;
+	std::vector<std::pair<int, int>> frames; // frames with events and how many
+	MIDIEvents events[BLOCK_SIZE];
+	for (int t = 0; t < .3f * get_sample_rate(); t += BLOCK_SIZE) {
+		ManualClock::time = seconds(t * DT);
+		if (t == 0) {
+			receiver.add(MIDIEvent::create_note_on(60, 100, 0), seconds(.01));
+			receiver.add(MIDIEvent::create_note_on(64, 100, 0), seconds(.01 + .5 * DT));
+			receiver.add(MIDIEvent::create_note_on(67, 100, 0), seconds(.11));
+		}
+		receiver.process_block(events, BLOCK_SIZE);
+		for (int i = 0; i < BLOCK_SIZE; ++i) {
+			if (!events[i].is_empty()) {
+				frames.push_back({t + i, events[i].end() - events[i].begin()});
+			}
+		}
+	}
+	const int first = int(std::floor(.01 / DT)) + BLOCK_SIZE;
+	const int second = int(std::floor(.11 / DT)) + BLOCK_SIZE;
+	check("a chord received by a MIDIReceiver is played on one frame", frames.size() == 2 && frames[0] == std::make_pair(first, 2));
+	check("the next note follows it after its delay", frames.size() == 2 && frames[1] == std::make_pair(second, 1));
+	// the chord as one event per frame, for processors that take a MIDIEvent
+	OneEventPerFrame one_event;
+	MIDIEvents chord;
+	for (uchar note: {60, 64, 67}) {
+		chord.add(MIDIEvent::create_note_on(note, 100, 0));
+	}
+	const bool in_order = one_event.process(chord).data1 == 60 && one_event.process(MIDIEvents()).data1 == 64 && one_event.process(MIDIEvents()).data1 == 67 && !one_event.process(MIDIEvents());
+	check("OneEventPerFrame plays a chord on consecutive frames", in_order && one_event.get_tail() == 0);
+}
+
+// every stem of a StemRenderer is the same file as a render of that output alone
+void test_stem_renderer() {
+	const int frames = 10000;
+	const char* stems[] = {"stem0.wav", "stem1.wav", "stem2.wav"};
+	{
+		ThreadPool pool(4);
+		Band band;
+		StemRenderer renderer(pool, "master.wav");
+		for (std::size_t i = 0; i < 3; ++i) {
+			renderer.add(*band.get_outputs()[i], stems[i]);
+		}
+		renderer.run(frames);
+	}
+	bool same = true;
+	for (std::size_t i = 0; i < 3; ++i) {
+		{
+			Band band;
+			WAVOutput wav("single.wav");
+			wav.run(*band.get_outputs()[i], frames);
+		}
+		const std::vector<char> stem = read_file(stems[i]);
+		same = same && stem.size() == 44 + frames * 4 && stem == read_file("single.wav");
+		remove(stems[i]);
+	}
+	remove("single.wav");
+	remove("master.wav");
+	check("each stem matches a render of its output alone", same);
+}
+
+// WAVOutput and ALSAOutput round to the nearest step on both sides of zero and saturate at full scale
+void test_quantize() {
+	const bool nearest = quantize(.4f, 32767.f) == 0 && quantize(.6f, 32767.f) == 1 && quantize(-.4f, 32767.f) == 0 && quantize(-.6f, 32767.f) == -1;
+	const bool saturated = quantize(2.f * 32767.f, 32767.f) == 32767 && quantize(-2.f * 32767.f, 32767.f) == -32767;
+	check("samples are rounded to the nearest step and saturated", nearest && saturated);
+}
+
+// silence written with dither stays within one step and is not biased
+void test_dither() {
+	const int frames = 100000;
+	{
+		WAVOutput wav("dither.wav", WAVOutput::S16, true);
+		Value<Sample> silence;
+		wav.run(silence, frames);
+	}
+	std::vector<int16_t> samples(frames * 2);
+	std::ifstream file("dither.wav", std::ios_base::binary);
+	file.seekg(44);
+	file.read(reinterpret_cast<char*>(samples.data()), samples.size() * sizeof(int16_t));
+	const bool complete = file.gcount() == std::streamsize(samples.size() * sizeof(int16_t));
+	file.close();
+	remove("dither.wav");
+	bool within = complete;
+	long sum = 0;
+	int nonzero = 0;
+	for (int16_t sample: samples) {
+		within = within && sample >= -1 && sample <= 1;
+		sum += sample;
+		nonzero += sample != 0;
+	}
+	check("dithered silence stays within one step", within);
+	check("dithered silence is noise around zero", nonzero > frames / 10 && std::abs(sum) < frames / 100);
+}
+
+int main() {
+	test_caches();
+	test_automation();
+	test_automation_against_parser();
+	test_control_rate();
+	test_envelopes();
+	test_sleeping();
+	test_noise();
+	test_parallel_mix();
+	test_nested_mix();
+	test_midi_receiver();
+	test_sequencer();
+	test_stem_renderer();
+	test_quantize();
+	test_dither();
+	return failures > 0;
+}
@@ -22,23 +22,21 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 namespace modo {
 
 class Leslie {
-	RingBuffer<float, 32> buffer;
+	// the delays and the rotation are tuned in samples at 44.1 kHz
+	float scale = get_sample_rate() / 44100.f;
+	DelayLine buffer{scale_to_sample_rate(32)};
 	float sin = 0.f;
 	float cos = 1.f;
-	float get_linear(float i) {
-		std::size_t lower = i;
-		float factor = i - lower;
-		std::size_t upper = lower + 1;
-		return buffer[lower] * (1.f - factor) + buffer[upper] * factor;
-	}
 public:
 	Sample process(float input, float frequency_factor) {
-		--buffer;
-		buffer[0] = input;
-		const float f = .0002f * frequency_factor;
+		buffer.write(input);
+		const float f = .0002f * frequency_factor / scale;
 		cos += -sin * f;
 		sin += cos * f;
-		return Pan::process(get_linear(sin * 15.f + 16.f), cos * .3f) + Pan::process(get_linear(sin * -15.f + 16.f), cos * -.3f);
+		return Pan::process(buffer.read_linear((sin * 15.f + 16.f) * scale), cos * .3f) + Pan::process(buffer.read_linear((sin * -15.f + 16.f) * scale), cos * -.3f);
+	}
+	template <class Archive> void serialize(Archive& archive) {
+		archive(buffer, sin, cos);
 	}
 };
 
@@ -18,15 +18,247 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 #pragma once
 
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <array>
+#include <algorithm>
+#include <atomic>
+#include <vector>
 #include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <limits>
+#include <type_traits>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#ifdef MODO_PROFILE
+#include <cstdio>
+#include <cxxabi.h>
+#include <typeinfo>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+#endif
 
 namespace modo {
 
 using uint = unsigned int;
 using uchar = unsigned char;
+template <class T, std::size_t N> struct VectorType {
+	// GCC/Clang vector extension, compiled to SSE/AVX/NEON registers where available
+	// only aligned like T, so that vectors can live in heap-allocated nodes before C++17's aligned new
+	typedef T type __attribute__((vector_size(N * sizeof(T)), aligned(alignof(T))));
+};
+template <class T, std::size_t N> using Vector = typename VectorType<T, N>::type;
+// the number of floats in the widest vector registers of the target, e.g. for the voices of Voices
+// wider vectors take several registers and are passed to and returned from functions through memory
+#if defined(__AVX512F__)
+constexpr std::size_t NATIVE_LANES = 16;
+#elif defined(__AVX__)
+constexpr std::size_t NATIVE_LANES = 8;
+#else
+constexpr std::size_t NATIVE_LANES = 4;
+#endif
+// the helpers for vectors take them by value: a template parameter deduced from a vector is naturally aligned,
+// so a reference to it can't bind to a Vector member, which is only aligned like its elements
+// lane-wise mask ? a : b, where mask is the result of a vector comparison
+template <class M, class V> V select(M mask, V a, V b) {
+	return reinterpret_cast<V>((reinterpret_cast<M>(a) & mask) | (reinterpret_cast<M>(b) & ~mask));
+}
+// a vector with every lane set to value
+template <class V, class T> constexpr V broadcast(T value) {
+	return V{} + value;
+}
+// lane-wise a < b as a mask, computed from the sign of a - b since GCC falls back to scalar code for
+// comparisons of vectors wider than the hardware (e.g. 8 floats without AVX)
+template <class M, class V> M less(V a, V b) {
+	return reinterpret_cast<M>(a - b) >> 31;
+}
 constexpr float PI = 3.1415927f;
-constexpr float DT = 1.f / 44100.f;
+constexpr int BLOCK_SIZE = 64;
+
+#ifdef MODO_SAMPLE_RATE
+// a sample rate fixed at compile time, which the compiler can fold into the constants of the hot loops
+// (DT can't be raised then, so Oversampled is not available)
+constexpr float get_sample_rate() {
+	return MODO_SAMPLE_RATE;
+}
+constexpr float DT = 1.f / MODO_SAMPLE_RATE;
+class Oversampling {
+public:
+	Oversampling(int factor) {}
+};
+#else
+template <class T = void> struct SampleRate {
+	static float rate;
+	static float dt;
+	static thread_local float scale; // 1 / the oversampling factor of the processor running on this thread
+};
+template <class T> float SampleRate<T>::rate = 44100.f;
+template <class T> float SampleRate<T>::dt = 1.f / 44100.f;
+template <class T> thread_local float SampleRate<T>::scale = 1.f;
+// nodes read the sample rate when they are created or their parameters change, so set it before building a graph
+// e.g. set_sample_rate(22050.f) for a quick preview
+inline void set_sample_rate(float rate) {
+	SampleRate<>::rate = rate;
+	SampleRate<>::dt = 1.f / rate;
+}
+inline float get_sample_rate() {
+	return SampleRate<>::rate / SampleRate<>::scale;
+}
+// the duration of a sample in seconds, converts to float
+struct SamplePeriod {
+	operator float() const {
+		return SampleRate<>::dt * SampleRate<>::scale;
+	}
+};
+constexpr SamplePeriod DT{};
+// raises the sample rate that processors see on this thread by factor until the end of the scope, see Oversampled
+class Oversampling {
+	float scale;
+public:
+	Oversampling(int factor): scale(SampleRate<>::scale) {
+		SampleRate<>::scale = scale / factor;
+	}
+	~Oversampling() {
+		SampleRate<>::scale = scale;
+	}
+	Oversampling(const Oversampling&) = delete;
+	Oversampling& operator =(const Oversampling&) = delete;
+};
+#endif
+// lengths that the original algorithms give in samples at 44.1 kHz, scaled to the sample rate
+inline std::size_t scale_to_sample_rate(std::size_t samples) {
+	return samples * get_sample_rate() / 44100.f + .5f;
+}
+
+constexpr float saturate(float x) {
+	return x > 1.f ? 1.f : (x < -1.f ? -1.f : x);
+}
+// a sample scaled to integer steps, saturated at +-limit and rounded to the nearest step (also below zero,
+// so that dither has no dead zone around it), shared by WAVOutput and ALSAOutput
+inline int32_t quantize(float value, float limit) {
+	return std::floor((value > limit ? limit : (value < -limit ? -limit : value)) + .5f);
+}
+
+// denormal numbers appear when the state of recursive filters decays towards zero and are slow on most CPUs
+// the output classes and the ThreadPool workers render under a DenormalGuard, and processors with recursive
+// state also flush it themselves, for when they are run without one: with flush_denormal, or like Freeverb
+// by clearing it once their output has been silent for their whole tail
+// numbers below 1e-30 are flushed, so that their products with filter coefficients don't become denormal
+constexpr float DENORMAL = 1e-30f;
+inline float flush_denormal(float x) {
+	return std::abs(x) < DENORMAL ? 0.f : x;
+}
+// the same for every lane of a vector
+template <class V> V flush_denormals(V x) {
+	using M = Vector<int32_t, sizeof(V) / sizeof(float)>;
+	const V min = V{} + DENORMAL;
+	// flushed if x - min and -min - x are both negative, see less()
+	const M denormal = (reinterpret_cast<M>(x - min) & reinterpret_cast<M>(-min - x)) >> 31;
+	return reinterpret_cast<V>(reinterpret_cast<M>(x) & ~denormal);
+}
+// makes the CPU flush denormals to zero until the end of the scope (FTZ and DAZ on x86, FZ on ARM64)
+class DenormalGuard {
+#if defined(__SSE__)
+	unsigned int csr;
+public:
+	DenormalGuard(): csr(_mm_getcsr()) {
+		_mm_setcsr(csr | 0x8040);
+	}
+	~DenormalGuard() {
+		_mm_setcsr(csr);
+	}
+#elif defined(__aarch64__)
+	uint64_t fpcr;
+public:
+	DenormalGuard() {
+		__asm__ volatile("mrs %0, fpcr" : "=r"(fpcr));
+		__asm__ volatile("msr fpcr, %0" : : "r"(fpcr | (uint64_t(1) << 24)));
+	}
+	~DenormalGuard() {
+		__asm__ volatile("msr fpcr, %0" : : "r"(fpcr));
+	}
+#else
+public:
+	DenormalGuard() {}
+#endif
+	DenormalGuard(const DenormalGuard&) = delete;
+	DenormalGuard& operator =(const DenormalGuard&) = delete;
+};
+
+// fast approximations of libm functions, for floats and, without branches, for float vectors
+// the error bounds are measured against libm in examples/benchmark.cc
+// minimax polynomial for 2^f on [0, 1)
+template <class T> T exp2_polynomial(T f) {
+	return .999999925f + f * (.693153073f + f * (.240153619f + f * (.0558263153f + f * (.00898934196f + f * .00187757635f))));
+}
+// log2(1 + t) / t for 1 + t in [sqrt(.5), sqrt(2))
+template <class T> T log2_polynomial(T t) {
+	return 1.44269492f + t * (-.721352488f + t * (.48093116f + t * (-.360263439f + t * (.286868933f + t * (-.248323178f + t * (.235709311f + t * -.149731627f))))));
+}
+inline float bits_to_float(int32_t bits) {
+	float result;
+	std::memcpy(&result, &bits, sizeof(float));
+	return result;
+}
+inline int32_t float_to_bits(float x) {
+	int32_t result;
+	std::memcpy(&result, &x, sizeof(float));
+	return result;
+}
+// relative error below 2e-7, x is clamped to [-126, 126]
+inline float fast_exp2(float x) {
+	x = std::min(std::max(x, -126.f), 126.f);
+	const int32_t whole = static_cast<int32_t>(x + 127.f) - 127; // x + 127 is positive, so truncation rounds down
+	return exp2_polynomial(x - whole) * bits_to_float((whole + 127) << 23);
+}
+template <class V> V fast_exp2(V x) {
+	using Ints = Vector<int32_t, sizeof(V) / sizeof(float)>;
+	const V low = broadcast<V>(-126.f);
+	const V high = broadcast<V>(126.f);
+	x = select(less<Ints>(x, low), low, x);
+	x = select(less<Ints>(high, x), high, x);
+	const Ints whole = __builtin_convertvector(x + 127.f, Ints) - 127;
+	return exp2_polynomial(x - __builtin_convertvector(whole, V)) * reinterpret_cast<V>((whole + 127) << 23);
+}
+// absolute error below 3e-7, for positive normal x
+inline float fast_log2(float x) {
+	const int32_t bits = float_to_bits(x);
+	// split into exponent and a mantissa in [sqrt(.5), sqrt(2))
+	const int32_t offset = (bits - 0x3F3504F3) & int32_t(0xFF800000);
+	const float t = bits_to_float(bits - offset) - 1.f;
+	return (offset >> 23) + t * log2_polynomial(t);
+}
+template <class V> V fast_log2(V x) {
+	using Ints = Vector<int32_t, sizeof(V) / sizeof(float)>;
+	const Ints bits = reinterpret_cast<Ints>(x);
+	const Ints offset = (bits - 0x3F3504F3) & int32_t(0xFF800000);
+	const V t = reinterpret_cast<V>(bits - offset) - 1.f;
+	return __builtin_convertvector(offset >> 23, V) + t * log2_polynomial(t);
+}
+// for positive x, the relative error is below 2e-7 + 2e-7 * |y * log2(x)|
+inline float fast_pow(float x, float y) {
+	return fast_exp2(y * fast_log2(x));
+}
+template <class V> V fast_pow(V x, V y) {
+	return fast_exp2(y * fast_log2(x));
+}
+// absolute error below 2e-7
+inline float fast_tanh(float x) {
+	const float e = fast_exp2(std::abs(x) * -2.88539008f); // e^(-2|x|)
+	return std::copysign((1.f - e) / (1.f + e), x);
+}
+template <class V> V fast_tanh(V x) {
+	using Ints = Vector<int32_t, sizeof(V) / sizeof(float)>;
+	const Ints sign = reinterpret_cast<Ints>(x) & int32_t(0x80000000);
+	const V e = fast_exp2(reinterpret_cast<V>(reinterpret_cast<Ints>(x) ^ sign) * -2.88539008f);
+	return reinterpret_cast<V>(reinterpret_cast<Ints>((1.f - e) / (1.f + e)) | sign);
+}
 
 template <class T, std::size_t N> class RingBuffer {
 	T data[N];
@@ -44,6 +276,167 @@ public:
 	}
 };
 
+// the smallest power of two greater than n
+constexpr std::size_t power_of_two_above(std::size_t n) {
+	return n == 0 ? 1 : power_of_two_above(n >> 1) << 1;
+}
+
+// delay line for delays of up to length samples, with fractional reads
+// every sample is stored twice, size apart, so that reads behind the write position never wrap around
+// and the write position wraps with a mask instead of a modulo
+class DelayLine {
+	// a power of two with room for the longest delay, a block written at once and the interpolation neighbours
+	std::size_t size;
+	std::vector<float> data;
+	// the most recent sample, older samples follow at higher indices
+	std::size_t position = 0;
+	// Catmull-Rom spline through the samples at delays delay - 1 to delay + 2
+	float cubic(const float* x, float f) const {
+		return x[1] + f * (.5f * (x[2] - x[0]) + f * (x[0] - 2.5f * x[1] + 2.f * x[2] - .5f * x[3] + f * (1.5f * (x[1] - x[2]) + .5f * (x[3] - x[0]))));
+	}
+public:
+	DelayLine(std::size_t length): size(power_of_two_above(length + BLOCK_SIZE)), data(size * 2) {}
+	// only the first half, the second is a copy of it
+	template <class Archive> void serialize(Archive& archive) {
+		archive(position);
+		archive.array(data.data(), size);
+		std::copy_n(data.data(), size, data.data() + size);
+	}
+	void write(float sample) {
+		position = (position - 1) & (size - 1);
+		data[position] = sample;
+		data[position + size] = sample;
+	}
+	// writes n <= BLOCK_SIZE samples, oldest first
+	void write_block(const float* input, int n) {
+		if (position < std::size_t(n)) {
+			for (int i = 0; i < n; ++i) {
+				write(input[i]);
+			}
+			return;
+		}
+		position -= n;
+		float* newest = data.data() + position + (n - 1);
+		for (int i = 0; i < n; ++i) {
+			newest[-i] = input[i];
+			newest[size - i] = input[i];
+		}
+	}
+	// a delay of 0 is the most recently written sample, delay <= length
+	float read(std::size_t delay) const {
+		return data[position + delay];
+	}
+	// delay <= length
+	float read_linear(float delay) const {
+		const int whole = delay;
+		const float f = delay - whole;
+		const float* x = data.data() + position + whole;
+		return x[0] + (x[1] - x[0]) * f;
+	}
+	// smoother than read_linear for modulated delays, 1 <= delay <= length
+	float read_cubic(float delay) const {
+		const int whole = delay;
+		return cubic(data.data() + position + whole - 1, delay - whole);
+	}
+	// first-order allpass interpolation, which keeps the high frequencies but should only be used for delays
+	// that change slowly; state is the previous output, 1 <= delay <= length
+	float read_allpass(float delay, float& state) const {
+		const int whole = delay;
+		const float f = delay - whole;
+		// most accurate for fractions between .1 and 1.1
+		const int base = f < .1f ? whole - 1 : whole;
+		const float fraction = delay - base;
+		const float a = (1.f - fraction) / (1.f + fraction);
+		const float* x = data.data() + position + base;
+		state = a * x[0] + x[1] - a * state;
+		return state;
+	}
+	// after write_block, reads the last n samples delayed by a constant delay <= length
+	void read_block(float delay, float* output, int n) const {
+		const int whole = delay;
+		const float f = delay - whole;
+		const float* x = data.data() + position + (n - 1) + whole;
+		for (int i = 0; i < n; ++i) {
+			output[i] = x[-i] + (x[1 - i] - x[-i]) * f;
+		}
+	}
+	// after write_block, reads the last n samples delayed by a different amount each, 1 <= delays[i] <= length
+	void read_cubic_block(const float* delays, float* output, int n) const {
+		const float* newest = data.data() + position + (n - 1);
+		for (int i = 0; i < n; ++i) {
+			const int whole = delays[i];
+			output[i] = cubic(newest - i + whole - 1, delays[i] - whole);
+		}
+	}
+};
+
+// radix-2 complex FFT of a power of two size on separate arrays of real and imaginary parts, unscaled
+// forward(imag, real) is the inverse transform (times size), since swapping the parts conjugates
+class FFT {
+	int size;
+	std::vector<int> reversed; // bit-reversed indices
+	// the twiddle factors e^(-i pi k / half) of the pass that combines transforms of size half are at half + k
+	std::vector<float> twiddle_real;
+	std::vector<float> twiddle_imag;
+	// combines the transforms of size half into ones of size 2 * half, T is float or a vector of floats
+	template <class T> void pass(T* real, T* imag, int half) const {
+		constexpr int lanes = sizeof(T) / sizeof(float);
+		const T* wr = reinterpret_cast<const T*>(twiddle_real.data() + half);
+		const T* wi = reinterpret_cast<const T*>(twiddle_imag.data() + half);
+		for (int start = 0; start < size / lanes; start += 2 * half / lanes) {
+			T* ar = real + start;
+			T* ai = imag + start;
+			T* br = ar + half / lanes;
+			T* bi = ai + half / lanes;
+			for (int k = 0; k < half / lanes; ++k) {
+				const T tr = br[k] * wr[k] - bi[k] * wi[k];
+				const T ti = br[k] * wi[k] + bi[k] * wr[k];
+				br[k] = ar[k] - tr;
+				bi[k] = ai[k] - ti;
+				ar[k] += tr;
+				ai[k] += ti;
+			}
+		}
+	}
+public:
+	FFT(int size): size(size), reversed(size), twiddle_real(size), twiddle_imag(size) {
+		for (int i = 0, j = 0; i < size; ++i) {
+			reversed[i] = j;
+			int bit = size >> 1;
+			for (; j & bit; bit >>= 1) {
+				j ^= bit;
+			}
+			j |= bit;
+		}
+		for (int half = 1; half < size; half *= 2) {
+			for (int k = 0; k < half; ++k) {
+				const double angle = -3.14159265358979323846 * k / half;
+				twiddle_real[half + k] = std::cos(angle);
+				twiddle_imag[half + k] = std::sin(angle);
+			}
+		}
+	}
+	int get_size() const {
+		return size;
+	}
+	void forward(float* real, float* imag) const {
+		for (int i = 0; i < size; ++i) {
+			if (i < reversed[i]) {
+				std::swap(real[i], real[reversed[i]]);
+				std::swap(imag[i], imag[reversed[i]]);
+			}
+		}
+		for (int half = 1; half < size; half *= 2) {
+			if (half < 4) {
+				pass(real, imag, half);
+			}
+			else {
+				pass(reinterpret_cast<Vector<float, 4>*>(real), reinterpret_cast<Vector<float, 4>*>(imag), half);
+			}
+		}
+	}
+};
+
 template <class T, std::size_t N> class Queue {
 	RingBuffer<T, N> buffer;
 	std::size_t size;
@@ -64,6 +457,45 @@ public:
 	}
 };
 
+// wait-free queue between one producer thread and one consumer thread, N must be a power of two
+template <class T, std::size_t N> class SPSCQueue {
+	static_assert((N & (N - 1)) == 0, "N must be a power of two");
+	std::array<T, N> buffer;
+	std::atomic<std::size_t> head; // written by the consumer
+	std::atomic<std::size_t> tail; // written by the producer
+public:
+	SPSCQueue(): buffer(), head(0), tail(0) {}
+	// returns false if the queue is full
+	bool put(const T& element) {
+		const std::size_t tail = this->tail.load(std::memory_order_relaxed);
+		if (tail - head.load(std::memory_order_acquire) == N) {
+			return false;
+		}
+		buffer[tail & (N - 1)] = element;
+		this->tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+	// returns false if the queue is empty
+	bool peek(T& element) const {
+		const std::size_t head = this->head.load(std::memory_order_relaxed);
+		if (head == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		element = buffer[head & (N - 1)];
+		return true;
+	}
+	bool take(T& element) {
+		if (!peek(element)) {
+			return false;
+		}
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		return true;
+	}
+	std::size_t get_size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+};
+
 class Xorshift128plus {
 	// xorshift128+ algorithm by Sebastiano Vigna
 	uint64_t s[2];
@@ -78,16 +510,13 @@ public:
 	}
 };
 
-class Random {
-public:
-	static uint64_t get() {
-		static Xorshift128plus generator;
-		return generator.get_next();
-	}
-	static float get_float() {
-		return get() / static_cast<float>(0xFFFFFFFFFFFFFFFF);
-	}
-};
+// splitmix64 by Sebastiano Vigna, turns consecutive seeds into well-mixed generator states
+inline uint64_t splitmix64(uint64_t& state) {
+	uint64_t z = (state += 0x9E3779B97F4A7C15);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+	return z ^ (z >> 31);
+}
 
 struct Sample {
 	float left;
@@ -103,10 +532,264 @@ struct Sample {
 	}
 };
 
+// -120 dB, anything quieter counts as silence
+constexpr float SILENCE = 1e-6f;
+inline bool is_silent(float sample) {
+	return std::abs(sample) < SILENCE;
+}
+inline bool is_silent(const Sample& sample) {
+	return is_silent(sample.left) && is_silent(sample.right);
+}
+// values of other types are never silent, unless there is an overload for them (see MIDIEvent)
+template <class T> bool is_silent(const T& value) {
+	return false;
+}
+
+// the state of a graph as a binary blob, to continue rendering from a point in time (see Checkpoints)
+// Output::serialize passes the state of a node and then that of its inputs to the archive, each node once, so
+// saving and loading visit the nodes in the same order and a state can only be loaded into the graph it was
+// saved from (or one built the same way); processors are copied as bytes if they are trivially copyable,
+// otherwise they list their state in a template <class Archive> void serialize(Archive& archive), see Delay
+// pointers are copied as they are (e.g. to shared tables), so a state is only valid in the process that saved it
+class StateArchive {
+	std::vector<char>* output;
+	const char* input;
+	std::size_t input_size;
+	std::size_t position = 0;
+	bool complete = true;
+	std::vector<const void*> nodes;
+	StateArchive(std::vector<char>* output, const char* input, std::size_t input_size): output(output), input(input), input_size(input_size) {}
+	void transfer(void* data, std::size_t size) {
+		if (output) {
+			output->insert(output->end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+		}
+		else if (position + size <= input_size) {
+			std::memcpy(data, input + position, size);
+		}
+		else {
+			complete = false;
+		}
+		position += size;
+	}
+	template <class T> auto apply(int, T& value) -> decltype(value.serialize(*this), void()) {
+		value.serialize(*this);
+	}
+	template <class T> void apply(int, std::vector<T>& values) {
+		std::size_t size = values.size();
+		apply(0, size);
+		if (size != values.size()) {
+			complete = false;
+			return;
+		}
+		array(values.data(), size);
+	}
+	template <class T> void apply(long, T& value) {
+		copy(std::integral_constant<int, !std::is_trivially_copyable<T>::value || !std::is_copy_assignable<T>::value ? 0 : (std::is_class<T>::value ? 1 : 2)>(), value);
+	}
+	template <class T> void copy(std::integral_constant<int, 0>, T& value) {
+		complete = false;
+	}
+	// classes through a copy, since value may be a base class whose tail padding holds members of the derived class
+	template <class T> void copy(std::integral_constant<int, 1>, T& value) {
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type copy;
+		std::memcpy(&copy, &value, sizeof(T));
+		transfer(&copy, sizeof(T));
+		value = reinterpret_cast<const T&>(copy);
+	}
+	// other types directly, vectors for example may be less aligned than T says (see VectorType)
+	template <class T> void copy(std::integral_constant<int, 2>, T& value) {
+		transfer(&value, sizeof(T));
+	}
+	template <class T> void copy_array(std::true_type, T* values, std::size_t n) {
+		transfer(values, n * sizeof(T));
+	}
+	template <class T> void copy_array(std::false_type, T* values, std::size_t n) {
+		for (std::size_t i = 0; i < n; ++i) {
+			apply(0, values[i]);
+		}
+	}
+public:
+	// saves or loads the values in order
+	template <class... T> void operator ()(T&... values) {
+		int expand[] = {(apply(0, values), 0)...};
+		(void)expand;
+	}
+	template <class T> void array(T* values, std::size_t n) {
+		copy_array(std::integral_constant<bool, std::is_trivially_copyable<T>::value && std::is_copy_assignable<T>::value>(), values, n);
+	}
+	// returns true the first time a node is visited
+	bool visit(const void* node) {
+		if (std::find(nodes.begin(), nodes.end(), node) != nodes.end()) {
+			return false;
+		}
+		nodes.push_back(node);
+		return true;
+	}
+	// called for state that can't be saved
+	void fail() {
+		complete = false;
+	}
+	// appends the state of output and the nodes it depends on to state, returns false if some of it couldn't be saved
+	template <class O> static bool save(O& output, std::vector<char>& state) {
+		StateArchive archive(&state, nullptr, 0);
+		output.serialize(archive);
+		return archive.complete;
+	}
+	// returns false if the state doesn't match the graph, which is then left in an undefined state
+	template <class O> static bool load(O& output, const std::vector<char>& state) {
+		StateArchive archive(nullptr, state.data(), state.size());
+		output.serialize(archive);
+		return archive.complete && archive.position == state.size();
+	}
+};
+
 template <class T> class Output {
 public:
 	virtual T get(int t) = 0;
+	// fills buffer with the samples t to t+n-1 (n must not exceed BLOCK_SIZE)
+	virtual void get_block(int t, T* buffer, int n) {
+		for (int i = 0; i < n; ++i) {
+			buffer[i] = get(t + i);
+		}
+	}
+	// like get_block, and returns true if the whole block is silent (outputs that can't tell return false)
+	virtual bool get_block_silent(int t, T* buffer, int n) {
+		get_block(t, buffer, n);
+		return false;
+	}
+	// adds this output and every node it depends on to nodes
+	// outputs that don't know their inputs add nullptr as well, which stands for any node (see group_independent)
+	virtual void get_nodes(std::vector<const void*>& nodes) {
+		if (std::find(nodes.begin(), nodes.end(), this) == nodes.end()) {
+			nodes.push_back(this);
+			nodes.push_back(nullptr);
+		}
+	}
+	// saves or loads the state of this output and every node it depends on (outputs that don't know their state
+	// make the archive fail)
+	virtual void serialize(StateArchive& archive) {
+		archive.fail();
+	}
+};
+
+#ifdef MODO_PROFILE
+// per-node statistics of a profiling build (compiled with -DMODO_PROFILE), see Profile::report
+// without MODO_PROFILE the nodes contain no profiling code at all
+class Profile {
+	static std::mutex& get_mutex() {
+		static std::mutex mutex;
+		return mutex;
+	}
+	static std::vector<Profile*>& get_profiles() {
+		static std::vector<Profile*> profiles;
+		return profiles;
+	}
+public:
+	static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+	// measures the time until the end of the scope, minus the time of the nodes pulled within it
+	class Scope {
+		Profile& profile;
+		Scope* parent;
+		uint64_t children = 0;
+		uint64_t start;
+		static Scope*& get_current() {
+			static thread_local Scope* current = nullptr;
+			return current;
+		}
+	public:
+		Scope(Profile& profile): profile(profile), parent(get_current()), start(now()) {
+			get_current() = this;
+		}
+		~Scope() {
+			const uint64_t elapsed = now() - start;
+			profile.cycles += elapsed - children;
+			if (parent) {
+				parent->children += elapsed;
+			}
+			get_current() = parent;
+		}
+	};
+	const std::type_info* type = nullptr;
+	std::string name;
+	uint64_t calls = 0; // get and get_block calls
+	uint64_t hits = 0; // calls answered from the node's cache
+	uint64_t cycles = 0; // time stamp counter ticks spent in the node itself, without its inputs
+	uint64_t denormals = 0; // denormal output samples (there are none under a DenormalGuard)
+	Profile(const std::type_info* type = nullptr): type(type) {
+		std::lock_guard<std::mutex> lock(get_mutex());
+		get_profiles().push_back(this);
+	}
+	Profile(const Profile&) = delete;
+	~Profile() {
+		std::lock_guard<std::mutex> lock(get_mutex());
+		auto& profiles = get_profiles();
+		profiles.erase(std::find(profiles.begin(), profiles.end(), this));
+	}
+	std::string get_name() const {
+		if (!name.empty() || !type) {
+			return name;
+		}
+		int status;
+		char* demangled = abi::__cxa_demangle(type->name(), nullptr, nullptr, &status);
+		std::string result = status == 0 ? demangled : type->name();
+		std::free(demangled);
+		return result;
+	}
+	// a table of the count nodes that took the most time, with their share of the time of all nodes
+	static std::string report(std::size_t count = 10) {
+		std::lock_guard<std::mutex> lock(get_mutex());
+		std::vector<Profile*> profiles = get_profiles();
+		std::sort(profiles.begin(), profiles.end(), [](const Profile* a, const Profile* b) {
+			return a->cycles > b->cycles;
+		});
+		uint64_t total = 0;
+		for (const Profile* profile: profiles) {
+			total += profile->cycles;
+		}
+		std::string result = "  share        cycles       calls  cache hits   denormals  node\n";
+		for (std::size_t i = 0; i < std::min(count, profiles.size()); ++i) {
+			const Profile& profile = *profiles[i];
+			char line[128];
+			std::snprintf(line, sizeof(line), "%6.2f%% %13llu %11llu %10.1f%% %11llu  ", 100.0 * profile.cycles / std::max<uint64_t>(total, 1), (unsigned long long)profile.cycles, (unsigned long long)profile.calls, 100.0 * profile.hits / std::max<uint64_t>(profile.calls, 1), (unsigned long long)profile.denormals);
+			result += line + profile.get_name() + "\n";
+		}
+		return result;
+	}
+	static void reset() {
+		std::lock_guard<std::mutex> lock(get_mutex());
+		for (Profile* profile: get_profiles()) {
+			profile->calls = 0;
+			profile->hits = 0;
+			profile->cycles = 0;
+			profile->denormals = 0;
+		}
+	}
+	static int count_denormals(const float* values, int n) {
+		int count = 0;
+		for (int i = 0; i < n; ++i) {
+			count += std::fpclassify(values[i]) == FP_SUBNORMAL;
+		}
+		return count;
+	}
+	static int count_denormals(const Sample* values, int n) {
+		return count_denormals(reinterpret_cast<const float*>(values), n * 2);
+	}
+	template <class T> static int count_denormals(const T* values, int n) {
+		return 0;
+	}
 };
+#define MODO_PROFILE_CALL(profile, hit) (++(profile).calls, (profile).hits += (hit))
+#define MODO_PROFILE_SCOPE(profile) Profile::Scope profile_scope(profile)
+#else
+#define MODO_PROFILE_CALL(profile, hit)
+#define MODO_PROFILE_SCOPE(profile)
+#endif
 
 template <class T> class Value: public Output<T> {
 	T value;
@@ -118,6 +801,16 @@ public:
 	T get(int t) override {
 		return value;
 	}
+	void get_block(int t, T* buffer, int n) override {
+		std::fill_n(buffer, n, value);
+	}
+	bool get_block_silent(int t, T* buffer, int n) override {
+		std::fill_n(buffer, n, value);
+		return is_silent(value);
+	}
+	void get_nodes(std::vector<const void*>& nodes) override {}
+	// the value is a setting, not state
+	void serialize(StateArchive& archive) override {}
 };
 
 template <class T> class Input: public Output<T> {
@@ -135,6 +828,18 @@ public:
 	T get(int t) override {
 		return output->get(t);
 	}
+	void get_block(int t, T* buffer, int n) override {
+		output->get_block(t, buffer, n);
+	}
+	bool get_block_silent(int t, T* buffer, int n) override {
+		return output->get_block_silent(t, buffer, n);
+	}
+	void get_nodes(std::vector<const void*>& nodes) override {
+		output->get_nodes(nodes);
+	}
+	void serialize(StateArchive& archive) override {
+		output->serialize(archive);
+	}
 };
 
 template <class T> void operator >>(Output<T>& o, Input<T>& i) {
@@ -147,6 +852,21 @@ template <class T> void operator >>(const T& t, Input<T>& i) {
 template <class T> class Node: public Output<T> {
 	T value;
 	int t;
+#ifdef MODO_PROFILE
+	Profile profile;
+#endif
+protected:
+	// for subclasses, which have to override serialize to add their own state and inputs, see Gain
+	void serialize_cache(StateArchive& archive) {
+		archive(value, t);
+	}
+	// subclasses that can produce a block at once override this, see Gain
+	virtual void produce_block(int t, T* buffer, int n) {
+		for (int i = 0; i < n; ++i) {
+			this->t = t + i;
+			buffer[i] = produce();
+		}
+	}
 public:
 	Node(): value(), t(0) {}
 	virtual T produce() = 0;
@@ -154,17 +874,86 @@ public:
 		return output.get(t);
 	}
 	T get(int t) override {
+		MODO_PROFILE_CALL(profile, t == this->t);
 		if (t != this->t) {
+			MODO_PROFILE_SCOPE(profile);
+#ifdef MODO_PROFILE
+			profile.type = &typeid(*this);
+#endif
 			this->t = t;
 			value = produce();
 		}
 		return value;
 	}
+	// a cached sample at the start of the block is reused and the last sample of the block is cached, so that
+	// pulling a node by samples and by blocks produces every sample once
+	void get_block(int t, T* buffer, int n) override {
+		MODO_PROFILE_CALL(profile, t == this->t);
+		if (n <= 0) {
+			return;
+		}
+		MODO_PROFILE_SCOPE(profile);
+#ifdef MODO_PROFILE
+		profile.type = &typeid(*this);
+#endif
+		const int cached = t == this->t;
+		if (cached) {
+			buffer[0] = value;
+		}
+		produce_block(t + cached, buffer + cached, n - cached);
+		this->t = t + n - 1;
+		value = buffer[n - 1];
+	}
+	// the name of the node in profiling reports, instead of its type
+	void set_name(const std::string& name) {
+#ifdef MODO_PROFILE
+		profile.name = name;
+#endif
+	}
 };
 
+template <class... T> class TypeList {};
 template <class... T> class InputTuple;
+
+class NodeInfo {
+	template <class T, class Ret, class... Arg> static auto process_block(int, T& node, Ret* output, int n, const Arg*... inputs) -> decltype(node.process_block(inputs..., output, n)) {
+		return node.process_block(inputs..., output, n);
+	}
+	template <class T, class Ret, class... Arg> static void process_block(long, T& node, Ret* output, int n, const Arg*... inputs) {
+		for (int i = 0; i < n; ++i) {
+			output[i] = node.process(inputs[i]...);
+		}
+	}
+	template <class T> static auto get_tail(int, const T& node) -> decltype(node.get_tail()) {
+		return node.get_tail();
+	}
+	template <class T> static int get_tail(long, const T& node) {
+		return std::numeric_limits<int>::max();
+	}
+public:
+	template <class T, class Ret, class... Arg> static Ret get_return_type(Ret (T::*)(Arg...));
+	template          <class Ret, class... Arg> static Ret get_return_type(Ret (*)(Arg...));
+	template <class T, class Ret, class... Arg> static InputTuple<Arg...> get_input_tuple_type(Ret (T::*)(Arg...));
+	template          <class Ret, class... Arg> static InputTuple<Arg...> get_input_tuple_type(Ret (*)(Arg...));
+	template <class T, class Ret, class... Arg> static TypeList<Arg...> get_argument_types(Ret (T::*)(Arg...));
+	template          <class Ret, class... Arg> static TypeList<Arg...> get_argument_types(Ret (*)(Arg...));
+	template <class T> using return_type = decltype(get_return_type(&T::process));
+	template <class T> using input_tuple_type = decltype(get_input_tuple_type(&T::process));
+	template <class T> using argument_types = decltype(get_argument_types(&T::process));
+	// use the node's process_block if it has one, otherwise call process for every sample
+	template <class T, class Ret, class... Arg> static void process_block(T& node, Ret* output, int n, const Arg*... inputs) {
+		process_block(0, node, output, n, inputs...);
+	}
+	// how many more samples the output of the node may be audible if its first input stays silent
+	// nodes opt in with a get_tail method, the others are never done
+	template <class T> static int get_tail(const T& node) {
+		return get_tail(0, node);
+	}
+};
+
 template <class Head, class... Tail> class InputTuple<Head, Tail...> {
 	Input<Head> head;
+	std::array<Head, BLOCK_SIZE> buffer;
 	InputTuple<Tail...> tail;
 public:
 	template <class Arg0, class... Arg> void connect(Arg0&& argument0, Arg&&... arguments) {
@@ -174,6 +963,33 @@ public:
 	template <class T, class... Arg> decltype(auto) get_and_process(int t, T& node, Arg&&... arguments) {
 		return tail.get_and_process(t, node, std::forward<Arg>(arguments)..., head.get(t));
 	}
+	template <class T, class Ret, class... Arg> void get_block_and_process(int t, int n, T& node, Ret* output, const Arg*... inputs) {
+		head.get_block(t, buffer.data(), n);
+		tail.get_block_and_process(t, n, node, output, inputs..., static_cast<const Head*>(buffer.data()));
+	}
+	// pulls only the first input and returns whether it is silent, process_with_first_block pulls the rest
+	bool get_first_block(int t, int n) {
+		return head.get_block_silent(t, buffer.data(), n);
+	}
+	template <class T, class Ret> void process_with_first_block(int t, int n, T& node, Ret* output) {
+		tail.get_block_and_process(t, n, node, output, static_cast<const Head*>(buffer.data()));
+	}
+	// pulls the rest without processing, for a node that sleeps
+	void get_other_blocks(int t, int n) {
+		tail.get_blocks(t, n);
+	}
+	void get_blocks(int t, int n) {
+		head.get_block(t, buffer.data(), n);
+		tail.get_blocks(t, n);
+	}
+	void get_nodes(std::vector<const void*>& nodes) {
+		head.get_nodes(nodes);
+		tail.get_nodes(nodes);
+	}
+	void serialize(StateArchive& archive) {
+		head.serialize(archive);
+		tail.serialize(archive);
+	}
 };
 template <> class InputTuple<> {
 public:
@@ -181,34 +997,383 @@ public:
 	template <class T, class... Arg> decltype(auto) get_and_process(int t, T& node, Arg&&... arguments) {
 		return node.process(std::forward<Arg>(arguments)...);
 	}
+	template <class T, class Ret, class... Arg> void get_block_and_process(int t, int n, T& node, Ret* output, const Arg*... inputs) {
+		NodeInfo::process_block(node, output, n, inputs...);
+	}
+	bool get_first_block(int t, int n) {
+		return true;
+	}
+	template <class T, class Ret> void process_with_first_block(int t, int n, T& node, Ret* output) {
+		NodeInfo::process_block(node, output, n);
+	}
+	void get_other_blocks(int t, int n) {}
+	void get_blocks(int t, int n) {}
+	void get_nodes(std::vector<const void*>& nodes) {}
+	void serialize(StateArchive& archive) {}
 };
 
-class NodeInfo {
-public:
-	template <class T, class Ret, class... Arg> static Ret get_return_type(Ret (T::*)(Arg...));
-	template          <class Ret, class... Arg> static Ret get_return_type(Ret (*)(Arg...));
-	template <class T, class Ret, class... Arg> static InputTuple<Arg...> get_input_tuple_type(Ret (T::*)(Arg...));
-	template          <class Ret, class... Arg> static InputTuple<Arg...> get_input_tuple_type(Ret (*)(Arg...));
-	template <class T> using return_type = decltype(get_return_type(&T::process));
-	template <class T> using input_tuple_type = decltype(get_input_tuple_type(&T::process));
-};
-
+// a node whose tail is over (see NodeInfo::get_tail) sleeps through blocks in which its first input is silent:
+// it outputs silence without processing, but still pulls its other inputs, so that nodes feeding them like
+// automations keep time with the rest of the graph
 template <class T> class Node2: public T, public Output<NodeInfo::return_type<T>> {
 	NodeInfo::input_tuple_type<T> inputs;
-	NodeInfo::return_type<T> value;
-	int t;
+	// the cached samples t to t+size-1
+	std::array<NodeInfo::return_type<T>, BLOCK_SIZE> values;
+	int t = 0;
+	int size = 0;
+	bool silent = false;
+#ifdef MODO_PROFILE
+	Profile profile{&typeid(T)};
+#endif
 public:
 	using T::T;
 	template <class... Arg> void connect(Arg&&... arguments) {
 		inputs.connect(std::forward<Arg>(arguments)...);
 	}
+	// a sample right after the cached ones is added to them, so that a node pulled sample by sample (e.g. by a
+	// Gain) and by blocks processes every sample once
 	NodeInfo::return_type<T> get(int t) override {
-		if (t != this->t) {
+		MODO_PROFILE_CALL(profile, t - this->t >= 0 && t - this->t < size);
+		if (t - this->t >= 0 && t - this->t < size) {
+			return values[t - this->t];
+		}
+		MODO_PROFILE_SCOPE(profile);
+		if (t != this->t + size || size == BLOCK_SIZE) {
 			this->t = t;
-			value = inputs.get_and_process(t, *this);
+			size = 0;
+			silent = true;
 		}
+		const NodeInfo::return_type<T> value = inputs.get_and_process(t, *this);
+		values[size++] = value;
+		silent = silent && is_silent(value);
 		return value;
 	}
+	void get_block(int t, NodeInfo::return_type<T>* buffer, int n) override {
+		get_block_silent(t, buffer, n);
+	}
+	// any part of the cached samples is served from the cache, samples that continue them are processed and added
+	bool get_block_silent(int t, NodeInfo::return_type<T>* buffer, int n) override {
+		MODO_PROFILE_CALL(profile, t - this->t >= 0 && t + n - this->t <= size);
+		if (t - this->t < 0 || t + n - this->t > size) {
+			MODO_PROFILE_SCOPE(profile);
+			if (t - this->t < 0 || t - this->t > size) {
+				this->t = t;
+				size = 0;
+				silent = true;
+			}
+			else if (t + n - this->t > BLOCK_SIZE) {
+				// keep the cached samples from t on and make room for the rest of the block
+				const int offset = t - this->t;
+				std::copy(values.begin() + offset, values.begin() + size, values.begin());
+				this->t = t;
+				size -= offset;
+				silent = std::all_of(values.begin(), values.begin() + size, [](const NodeInfo::return_type<T>& value) {
+					return is_silent(value);
+				});
+			}
+			// the samples start to end-1 are missing
+			const int start = this->t + size;
+			const int count = t + n - start;
+			NodeInfo::return_type<T>* const values = this->values.data() + size;
+			const bool done = NodeInfo::get_tail(static_cast<const T&>(*this)) == 0;
+			if (done && inputs.get_first_block(start, count)) {
+				inputs.get_other_blocks(start, count);
+				std::fill_n(values, count, NodeInfo::return_type<T>());
+			}
+			else {
+				if (done) {
+					inputs.process_with_first_block(start, count, *this, values);
+				}
+				else {
+					inputs.get_block_and_process(start, count, *this, values);
+				}
+				// usually stops at the first sample
+				silent = silent && std::all_of(values, values + count, [](const NodeInfo::return_type<T>& value) {
+					return is_silent(value);
+				});
+#ifdef MODO_PROFILE
+				profile.denormals += Profile::count_denormals(values, count);
+#endif
+			}
+			size += count;
+		}
+		std::copy_n(values.data() + (t - this->t), n, buffer);
+		// silent if all of the cache is
+		return silent;
+	}
+	// the name of the node in profiling reports, instead of its type
+	void set_name(const std::string& name) {
+#ifdef MODO_PROFILE
+		profile.name = name;
+#endif
+	}
+	void get_nodes(std::vector<const void*>& nodes) override {
+		if (std::find(nodes.begin(), nodes.end(), this) == nodes.end()) {
+			nodes.push_back(this);
+			inputs.get_nodes(nodes);
+		}
+	}
+	// the processor and the cached samples, which nodes like ControlRate may ask for again
+	void serialize(StateArchive& archive) override {
+		if (archive.visit(this)) {
+			archive(static_cast<T&>(*this), t, size, silent);
+			archive.array(values.data(), std::min(std::max(size, 0), BLOCK_SIZE));
+			inputs.serialize(archive);
+		}
+	}
+};
+
+// evaluates its input only every K samples and interpolates linearly in between, for slowly changing signals
+// like cutoffs, gains or panning; the nodes behind it are only asked for every K-th time, at the ticks 1, 1+K,
+// 1+2K and so on, so nodes that count their own calls have to advance K samples per call (see Automation's stride)
+// the frames t to tick+K-1 are interpolated towards the input at tick+K, so the nodes behind it run up to K frames
+// ahead of the frames asked for and shouldn't also be pulled at audio rate by other nodes
+template <class T, int K = BLOCK_SIZE> class ControlRate: public Output<T> {
+	static_assert(K > 0 && (K & (K - 1)) == 0, "K must be a power of two");
+	static constexpr int NONE = std::numeric_limits<int>::min();
+	Input<T> input;
+	int tick = NONE;
+	T previous; // the input at tick
+	T next; // the input at tick + K
+	void update(int t) {
+		const int tick = ((t - 1) & ~(K - 1)) + 1;
+		if (tick == this->tick) {
+			return;
+		}
+		previous = this->tick != NONE && tick == this->tick + K ? next : input.get(tick);
+		next = input.get(tick + K);
+		this->tick = tick;
+	}
+public:
+	ControlRate(const T& value = T()): input(value), previous(value), next(value) {}
+	template <class Arg> void connect(Arg&& argument) {
+		input.connect(std::forward<Arg>(argument));
+		tick = NONE;
+	}
+	T get(int t) override {
+		update(t);
+		const float f = (t - tick) * (1.f / K);
+		return previous * (1.f - f) + next * f;
+	}
+	void get_block(int t, T* buffer, int n) override {
+		for (int i = 0; i < n;) {
+			update(t + i);
+			const int offset = t + i - tick;
+			const int size = std::min(n - i, K - offset);
+			for (int j = 0; j < size; ++j) {
+				const float f = (offset + j) * (1.f / K);
+				buffer[i + j] = previous * (1.f - f) + next * f;
+			}
+			i += size;
+		}
+	}
+	void get_nodes(std::vector<const void*>& nodes) override {
+		if (std::find(nodes.begin(), nodes.end(), this) == nodes.end()) {
+			nodes.push_back(this);
+			input.get_nodes(nodes);
+		}
+	}
+	void serialize(StateArchive& archive) override {
+		if (archive.visit(this)) {
+			archive(tick, previous, next);
+			input.serialize(archive);
+		}
+	}
+};
+
+// static composition: the output of A becomes the first input of B
+// the remaining inputs of A and B become the inputs of the chain, e.g. Node2<Chain<Snare, Pan>>
+template <class A, class B, class ArgumentsA = NodeInfo::argument_types<A>, class ArgumentsB = NodeInfo::argument_types<B>> class Chain;
+template <class A, class B, class... ArgA, class ArgB0, class... ArgB> class Chain<A, B, TypeList<ArgA...>, TypeList<ArgB0, ArgB...>> {
+public:
+	A first;
+	B second;
+	NodeInfo::return_type<B> process(ArgA... arguments_a, ArgB... arguments_b) {
+		return second.process(first.process(arguments_a...), arguments_b...);
+	}
+	template <class Archive> void serialize(Archive& archive) {
+		archive(first, second);
+	}
+	void process_block(const ArgA*... arguments_a, const ArgB*... arguments_b, NodeInfo::return_type<B>* output, int n) {
+		NodeInfo::return_type<A> output_a[BLOCK_SIZE];
+		NodeInfo::process_block(first, output_a, n, arguments_a...);
+		ArgB0 input_b[BLOCK_SIZE];
+		std::copy_n(output_a, n, input_b);
+		NodeInfo::process_block(second, output, n, static_cast<const ArgB0*>(input_b), arguments_b...);
+	}
+};
+
+// static composition: the outputs of A and B are added
+template <class A, class B, class ArgumentsA = NodeInfo::argument_types<A>, class ArgumentsB = NodeInfo::argument_types<B>> class Mix;
+template <class A, class B, class... ArgA, class... ArgB> class Mix<A, B, TypeList<ArgA...>, TypeList<ArgB...>> {
+public:
+	A first;
+	B second;
+	NodeInfo::return_type<A> process(ArgA... arguments_a, ArgB... arguments_b) {
+		return first.process(arguments_a...) + second.process(arguments_b...);
+	}
+	template <class Archive> void serialize(Archive& archive) {
+		archive(first, second);
+	}
+	void process_block(const ArgA*... arguments_a, const ArgB*... arguments_b, NodeInfo::return_type<A>* output, int n) {
+		NodeInfo::return_type<B> output_b[BLOCK_SIZE];
+		NodeInfo::process_block(first, output, n, arguments_a...);
+		NodeInfo::process_block(second, output_b, n, arguments_b...);
+		for (int i = 0; i < n; ++i) {
+			output[i] = output[i] + output_b[i];
+		}
+	}
+};
+
+// a half-band lowpass, the polyphase FIR for converting between a sample rate and twice that rate
+// besides the center tap of 1/2 only the odd taps are nonzero, so every conversion is one dot product of
+// the 2 * M odd taps with the last 2 * M samples; M = 16 keeps aliasing below -70 dB up to .4 times the lower rate
+// an instance converts in one direction only, since upsample and downsample share the history
+template <int M> class HalfBand {
+	using Lanes = Vector<float, 4>;
+	static_assert(M % 2 == 0, "M must be even");
+	float taps[2 * M]; // h[2 * (i - M) + 1], from the oldest sample to the newest
+	float history[2 * M + BLOCK_SIZE] = {}; // the last 2 * M samples followed by the samples being converted
+	float even[M - 1 + BLOCK_SIZE] = {}; // the same for the even samples of downsample, which are M - 1 samples late
+	float convolve(const float* samples) const {
+		const Lanes* h = reinterpret_cast<const Lanes*>(taps);
+		Lanes sum = {};
+		for (int i = 0; i < 2 * M / 4; ++i) {
+			sum += *reinterpret_cast<const Lanes*>(samples + 4 * i) * h[i];
+		}
+		return sum[0] + sum[1] + sum[2] + sum[3];
+	}
+public:
+	HalfBand() {
+		// windowed sinc with a Blackman window, scaled to a gain of exactly 1 at 0 Hz
+		float total = 0.f;
+		for (int i = 0; i < 2 * M; ++i) {
+			const int j = 2 * (i - M) + 1;
+			const double window = .42 + .5 * std::cos(PI * j / (2 * M)) + .08 * std::cos(2 * PI * j / (2 * M));
+			taps[i] = std::sin(PI * j / 2) / (PI * j) * window;
+			total += taps[i];
+		}
+		for (float& tap: taps) {
+			tap *= .5f / total;
+		}
+	}
+	// 2 * n samples at twice the rate for n inputs, M input samples late
+	void upsample(const float* input, float* output, int n) {
+		for (int start = 0; start < n; start += BLOCK_SIZE) {
+			const int length = std::min(BLOCK_SIZE, n - start);
+			std::copy_n(input + start, length, history + 2 * M);
+			for (int i = 0; i < length; ++i) {
+				output[2 * (start + i)] = history[i + M];
+				output[2 * (start + i) + 1] = 2.f * convolve(history + i + 1);
+			}
+			std::copy_n(history + length, 2 * M, history);
+		}
+	}
+	// n samples for 2 * n inputs at twice the rate, M - 1 output samples late
+	void downsample(const float* input, float* output, int n) {
+		for (int start = 0; start < n; start += BLOCK_SIZE) {
+			const int length = std::min(BLOCK_SIZE, n - start);
+			for (int i = 0; i < length; ++i) {
+				even[M - 1 + i] = input[2 * (start + i)];
+				history[2 * M + i] = input[2 * (start + i) + 1];
+			}
+			for (int i = 0; i < length; ++i) {
+				output[start + i] = .5f * even[i] + convolve(history + i + 1);
+			}
+			std::copy_n(even + length, M - 1, even);
+			std::copy_n(history + length, 2 * M, history);
+		}
+	}
+};
+
+// converts blocks of up to BLOCK_SIZE samples between the sample rate and Factor times the rate, in stages of 2
+// the stage next to the lower rate has to be sharp, the others can let more through, since what they
+// let through is filtered out by the next stage
+template <int Factor> class Resampler {
+	static_assert(Factor > 2 && (Factor & (Factor - 1)) == 0, "Factor must be a power of two");
+	Resampler<Factor / 2> lower;
+	HalfBand<4> up;
+	HalfBand<4> down;
+public:
+	void upsample(const float* input, float* output, int n) {
+		float half[Factor / 2 * BLOCK_SIZE];
+		lower.upsample(input, half, n);
+		up.upsample(half, output, Factor / 2 * n);
+	}
+	void downsample(const float* input, float* output, int n) {
+		float half[Factor / 2 * BLOCK_SIZE];
+		down.downsample(input, half, Factor / 2 * n);
+		lower.downsample(half, output, n);
+	}
+};
+template <> class Resampler<2> {
+	HalfBand<16> up;
+	HalfBand<16> down;
+public:
+	void upsample(const float* input, float* output, int n) {
+		up.upsample(input, output, n);
+	}
+	void downsample(const float* input, float* output, int n) {
+		down.downsample(input, output, n);
+	}
+};
+
+// runs T at Factor times the sample rate, e.g. naive oscillators and waveshapers that would alias otherwise:
+// T sees the higher rate in DT and get_sample_rate(), the first input is upsampled if it is a float (taking
+// it as the signal), the other inputs are held, and the output is filtered and decimated again
+// a first input that isn't a float, like MIDI events, only goes to the first of the Factor calls
+// adds a latency of about 33 samples
+template <class T, int Factor, class Arguments = NodeInfo::argument_types<T>> class Oversampled;
+template <class T, int Factor, class... Arg> class Oversampled<T, Factor, TypeList<Arg...>> {
+	static_assert(std::is_same<NodeInfo::return_type<T>, float>::value, "only processors that return float can be oversampled");
+#ifdef MODO_SAMPLE_RATE
+	static_assert(sizeof(T) == 0, "Oversampled needs the runtime sample rate, T would run at MODO_SAMPLE_RATE");
+#endif
+	Resampler<Factor> resampler;
+	template <class Arg0, class... Rest> void run(float* output, int n, const Arg0* input, const Rest*... arguments) {
+		for (int i = 0; i < n; ++i) {
+			for (int j = 0; j < Factor; ++j) {
+				output[Factor * i + j] = processor.process(j == 0 ? input[i] : Arg0(), arguments[i]...);
+			}
+		}
+	}
+	template <class... Rest> void run(float* output, int n, const float* input, const Rest*... arguments) {
+		float inputs[Factor * BLOCK_SIZE];
+		resampler.upsample(input, inputs, n);
+		for (int i = 0; i < n; ++i) {
+			for (int j = 0; j < Factor; ++j) {
+				output[Factor * i + j] = processor.process(inputs[Factor * i + j], arguments[i]...);
+			}
+		}
+	}
+	void run(float* output, int n) {
+		for (int i = 0; i < Factor * n; ++i) {
+			output[i] = processor.process();
+		}
+	}
+	// T is created at the higher rate too, for the lengths and coefficients it derives from it
+	template <class... A> static T create(A&&... arguments) {
+		Oversampling oversampling(Factor);
+		return T(std::forward<A>(arguments)...);
+	}
+public:
+	T processor;
+	template <class... A> Oversampled(A&&... arguments): processor(create(std::forward<A>(arguments)...)) {}
+	template <class Archive> void serialize(Archive& archive) {
+		archive(resampler, processor);
+	}
+	float process(Arg... arguments) {
+		float output;
+		process_block(&arguments..., &output, 1);
+		return output;
+	}
+	// n at most BLOCK_SIZE
+	void process_block(const Arg*... inputs, float* output, int n) {
+		Oversampling oversampling(Factor);
+		float outputs[Factor * BLOCK_SIZE];
+		run(outputs, n, inputs...);
+		resampler.downsample(outputs, output, n);
+	}
 };
 
 class Osc {
@@ -247,19 +1412,201 @@ public:
 	}
 };
 
+// band-limited single-cycle waveforms, one table per octave of the fundamental: level k holds harmonics 1 to 2^k,
+// for fundamentals up to half the sample rate / 2^k, so the tables don't depend on the sample rate
+// level k has 32 samples per period of its highest harmonic, at least 64 and at most 4096 (where the highest
+// harmonics are quiet), followed by a copy of the first for interpolation, so the tables of high notes are small
+// saw() and square() are built once and shared read-only by all oscillators
+class Wavetable {
+public:
+	static constexpr int LEVELS = 11;
+private:
+	std::vector<float> samples;
+	std::size_t offsets[LEVELS];
+public:
+	// amplitude(h) is the amplitude of the sine of harmonic h
+	template <class F> explicit Wavetable(F&& amplitude) {
+		std::size_t offset = 0;
+		for (int level = 0; level < LEVELS; ++level) {
+			offsets[level] = offset;
+			offset += (std::size_t(1) << get_bits(level)) + 1;
+		}
+		samples.resize(offset);
+		for (int level = 0; level < LEVELS; ++level) {
+			const int size = 1 << get_bits(level);
+			// a spectrum with only positive frequencies, the real part of its inverse transform is the sum of sines
+			std::vector<float> real(size), imag(size);
+			for (int h = 1; h <= (1 << level); ++h) {
+				imag[h] = -amplitude(h);
+			}
+			FFT(size).forward(imag.data(), real.data());
+			float* table = samples.data() + offsets[level];
+			std::copy(real.begin(), real.end(), table);
+			table[size] = table[0];
+		}
+	}
+	// the level for a phase increment in periods per sample times 2^32
+	static int get_level(int32_t increment) {
+		const uint32_t magnitude = increment < 0 ? -uint32_t(increment) : uint32_t(increment);
+		return std::min(__builtin_clz(magnitude | 1) - 1, LEVELS - 1);
+	}
+	// log2 of the size of a level
+	static constexpr int get_bits(int level) {
+		return std::min(std::max(5 + level, 6), 12);
+	}
+	const float* get_table(int level) const {
+		return samples.data() + offsets[level];
+	}
+	// rising from -1 to 1 like Saw
+	static const Wavetable& saw() {
+		static const Wavetable wavetable([](int h) {
+			return (h % 2 ? 2.f : -2.f) / (PI * h);
+		});
+		return wavetable;
+	}
+	// -1 for the first half of the period and 1 for the second like Square
+	static const Wavetable& square() {
+		static const Wavetable wavetable([](int h) {
+			return h % 2 ? -4.f / (PI * h) : 0.f;
+		});
+		return wavetable;
+	}
+	// the phase increment for a frequency, clamped to just below half the sample rate
+	static int32_t get_increment(float frequency) {
+		return std::min(std::max(frequency * DT, -.49999f), .49999f) * 4294967296.f;
+	}
+};
+
+// plays a Wavetable without aliasing, interpolating linearly in the table for the frequency
+class WavetableOsc {
+	const Wavetable* wavetable;
+	uint32_t phase = 0;
+	float frequency = 0.f;
+	int32_t increment = 0;
+	const float* table;
+	int bits;
+public:
+	explicit WavetableOsc(const Wavetable& wavetable = Wavetable::saw()): wavetable(&wavetable), table(wavetable.get_table(Wavetable::LEVELS - 1)), bits(Wavetable::get_bits(Wavetable::LEVELS - 1)) {}
+	float process(float frequency) {
+		if (frequency != this->frequency) {
+			this->frequency = frequency;
+			increment = Wavetable::get_increment(frequency);
+			const int level = Wavetable::get_level(increment);
+			table = wavetable->get_table(level);
+			bits = Wavetable::get_bits(level);
+		}
+		const uint32_t index = phase >> (32 - bits);
+		const float fraction = (phase << bits >> 8) * (1.f / (1 << 24));
+		phase += increment;
+		return table[index] + (table[index + 1] - table[index]) * fraction;
+	}
+};
+
+// white noise in [-1, 1), from xoshiro128+ streams (by Blackman and Vigna) that run side by side in vector lanes
+// every instance owns its generator, so the output only depends on the seed
 class Noise {
+	static constexpr std::size_t LANES = 8;
+	using State = Vector<uint32_t, LANES>;
+	State s[4];
+	float values[LANES];
+	std::size_t position = LANES;
+	void generate(float* output) {
+		const State result = s[0] + s[3];
+		const State t = s[1] << 9;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = (s[3] << 11) | (s[3] >> 21);
+		// the upper 23 bits as the mantissa of a float in [1, 2)
+		const Vector<float, LANES> floats = reinterpret_cast<Vector<float, LANES>>((result >> 9) | 0x3F800000) * 2.f - 3.f;
+		std::memcpy(output, &floats, sizeof(floats));
+	}
+	// every Noise constructed without a seed gets the next one, so that no two of them play the same noise
+	static uint64_t get_next_seed() {
+		static std::atomic<uint64_t> count(0);
+		uint64_t state = count++;
+		return splitmix64(state);
+	}
 public:
+	Noise(): Noise(get_next_seed()) {}
+	// the same seed gives the same noise
+	Noise(uint64_t seed) {
+		for (std::size_t lane = 0; lane < LANES; ++lane) {
+			const uint64_t a = splitmix64(seed);
+			const uint64_t b = splitmix64(seed);
+			s[0][lane] = a;
+			s[1][lane] = a >> 32;
+			s[2][lane] = b;
+			s[3][lane] = b >> 32;
+		}
+	}
 	float process() {
-		return Random::get_float() * 2.f - 1.f;
+		if (position == LANES) {
+			generate(values);
+			position = 0;
+		}
+		return values[position++];
+	}
+	// produces the same sequence as calling process n times
+	void process_block(float* output, int n) {
+		int i = 0;
+		for (; i < n && position < LANES; ++i) {
+			output[i] = values[position++];
+		}
+		for (; i + int(LANES) <= n; i += LANES) {
+			generate(output + i);
+		}
+		if (i < n) {
+			generate(values);
+			position = n - i;
+			std::copy_n(values, position, output + i);
+		}
+	}
+};
+
+class Gain: public Node<float> {
+public:
+	Input<float> input;
+	Input<float> amount;
+	float produce() override {
+		return get(input) * get(amount);
+	}
+	// pulls its inputs by blocks as well, so that nodes that also feed block consumers see the same requests
+	void produce_block(int t, float* buffer, int n) override {
+		float amount[BLOCK_SIZE];
+		input.get_block(t, buffer, n);
+		this->amount.get_block(t, amount, n);
+		for (int i = 0; i < n; ++i) {
+			buffer[i] *= amount[i];
+		}
+	}
+	void get_nodes(std::vector<const void*>& nodes) override {
+		if (std::find(nodes.begin(), nodes.end(), this) == nodes.end()) {
+			nodes.push_back(this);
+			input.get_nodes(nodes);
+			amount.get_nodes(nodes);
+		}
+	}
+	void serialize(StateArchive& archive) override {
+		if (archive.visit(this)) {
+			serialize_cache(archive);
+			input.serialize(archive);
+			amount.serialize(archive);
+		}
 	}
 };
 
-class Gain: public Node<float> {
+// a VCA: the input scaled by a gain, usually an envelope
+// while the gain is silent it sleeps and outputs silence, so the nodes after it can sleep too
+class Amplifier {
 public:
-	Input<float> input;
-	Input<float> amount;
-	float produce() override {
-		return get(input) * get(amount);
+	static constexpr float process(float gain, float input) {
+		return input * gain;
+	}
+	static constexpr int get_tail() {
+		return 0;
 	}
 };
 
@@ -268,6 +1615,9 @@ public:
 	static constexpr Sample process(float input, float panning) {
 		return Sample(input * (.5f - panning * .5f), input * (.5f + panning * .5f));
 	}
+	static constexpr int get_tail() {
+		return 0;
+	}
 };
 
 class Width {
@@ -275,6 +1625,9 @@ public:
 	static constexpr Sample process(Sample input, float width) {
 		return input * (.5f + width * .5f) + Sample(input.right, input.left) * (.5f - width * .5f);
 	}
+	static constexpr int get_tail() {
+		return 0;
+	}
 };
 
 class Mono {
@@ -282,6 +1635,9 @@ public:
 	static constexpr float process(Sample sample) {
 		return (sample.left + sample.right) * .5f;
 	}
+	static constexpr int get_tail() {
+		return 0;
+	}
 };
 
 class Clip {
@@ -289,6 +1645,9 @@ public:
 	static constexpr float process(float input) {
 		return input > .9f ? .9f : (input < -.9f ? -.9f : input);
 	}
+	static constexpr int get_tail() {
+		return 0;
+	}
 };
 
 class LowPass {
@@ -296,21 +1655,76 @@ class LowPass {
 public:
 	float process(float input, float cutoff) {
 		const float output = previous + (input - previous) * cutoff;
-		previous = output;
+		previous = flush_denormal(output);
 		return output;
 	}
+	// an IIR filter has no fixed tail, it is done once its state is silent
+	int get_tail() const {
+		return is_silent(previous) ? 0 : 1;
+	}
 };
 
+// N is the delay in samples at 44.1 kHz
 template <std::size_t N> class Delay {
-	RingBuffer<float, N> buffer;
+	std::size_t length = scale_to_sample_rate(N);
+	DelayLine buffer{length};
+	std::size_t quiet = 0; // silent samples written in a row, up to length
 public:
 	Sample process(float input, float feedback, float wet, float dry, float width) {
-		const float left = buffer[0] * (feedback * feedback);
-		const float right = buffer[N/2] * feedback;
-		buffer[0] = input + left;
-		++buffer;
+		const float left = buffer.read(length - 1) * (feedback * feedback);
+		const float right = buffer.read((length + 1) / 2 - 1) * feedback;
+		buffer.write(flush_denormal(input + left));
+		quiet = is_silent(input + left) ? std::min(quiet + 1, length) : 0;
 		return Width::process(Sample(left, right), width) * wet + Sample(input) * dry;
 	}
+	int get_tail() const {
+		return length - quiet;
+	}
+	template <class Archive> void serialize(Archive& archive) {
+		archive(buffer, quiet);
+	}
+};
+
+// two copies of the input, delayed by delay +/- depth seconds as a sine of the given rate, panned apart
+// delay - depth must be at least one sample, delay + depth at most 100 ms
+class Chorus {
+	DelayLine buffer{std::size_t(.1f * get_sample_rate())};
+	float sin = 0.f;
+	float cos = 1.f;
+public:
+	Sample process(float input, float rate, float delay, float depth, float wet, float dry) {
+		buffer.write(input);
+		const float f = rate * 2.f * PI * DT;
+		cos += -sin * f;
+		sin += cos * f;
+		const float left = buffer.read_cubic((delay + depth * sin) * (1.f / DT));
+		const float right = buffer.read_cubic((delay - depth * sin) * (1.f / DT));
+		return Sample(left, right) * wet + Sample(input) * dry;
+	}
+	template <class Archive> void serialize(Archive& archive) {
+		archive(buffer, sin, cos);
+	}
+};
+
+// the input mixed with a copy delayed by delay to delay + depth seconds, which sweeps a comb filter
+// delay must be at least one sample, delay + depth at most 20 ms
+class Flanger {
+	DelayLine buffer{std::size_t(.02f * get_sample_rate())};
+	float sin = 0.f;
+	float cos = 1.f;
+	float previous = 0.f;
+public:
+	float process(float input, float rate, float delay, float depth, float feedback, float mix) {
+		buffer.write(flush_denormal(input + previous * feedback));
+		const float f = rate * 2.f * PI * DT;
+		cos += -sin * f;
+		sin += cos * f;
+		previous = buffer.read_cubic((delay + depth * (.5f + .5f * sin)) * (1.f / DT));
+		return input * (1.f - mix) + previous * mix;
+	}
+	template <class Archive> void serialize(Archive& archive) {
+		archive(buffer, sin, cos, previous);
+	}
 };
 
 class Resonator {
@@ -323,96 +1737,368 @@ public:
 			s0 = s0 - s1*frequency + (input - s0)*frequency*sensitivity;
 			s1 = s1 + s0*frequency;
 		}
+		s0 = flush_denormal(s0);
+		s1 = flush_denormal(s1);
 		return s1;
 	}
+	int get_tail() const {
+		return is_silent(s0) && is_silent(s1) ? 0 : 1;
+	}
 };
 
 class Freeverb {
 	// freeverb algorithm by Jezar at Dreampoint
-	template <std::size_t N> class Comb {
-		std::array<float, N> buffer;
+	using Lanes = Vector<float, 8>;
+	// the 8 comb filters run as the lanes of one vector and share one interleaved history
+	// the result equals the scalar algorithm exactly, or within 1e-6 if the compiler contracts to FMA
+	// the filter lengths are given in samples at 44.1 kHz and scaled to the sample rate, like the spread S
+	class CombBank {
+		std::size_t sizes[8];
+		std::size_t mask;
+		std::vector<float> history; // interleaved, 8 floats per sample
+		Lanes previous;
 		std::size_t position;
-		float previous;
 	public:
-		Comb(): buffer(), position(0), previous(0.f) {}
-		float process(float input, float feedback, float damp) {
-			const float output = buffer[position];
-			// low-pass filter
-			const float filtered = output * (1.f - damp) + previous * damp;
-			previous = filtered;
-			buffer[position] = input + filtered * feedback;
-			position = (position + 1) % N;
-			return output;
+		CombBank(std::size_t spread): previous(), position(0) {
+			constexpr std::size_t lengths[8] = {1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617};
+			for (int lane = 0; lane < 8; ++lane) {
+				sizes[lane] = scale_to_sample_rate(lengths[lane] + spread);
+			}
+			// room for the longest comb filter and a block
+			mask = power_of_two_above(sizes[7] + BLOCK_SIZE) - 1;
+			history.resize((mask + 1) * 8);
+		}
+		// input, room_size and damp as given to Freeverb, scaled here so that no temporary buffers are needed
+		void process_block(const float* input, const float* room_size, const float* damp, float* output, int n) {
+			// keep the state in registers while processing the block
+			Lanes previous = this->previous;
+			std::size_t position = this->position;
+			Lanes* history = reinterpret_cast<Lanes*>(this->history.data());
+			const std::size_t mask = this->mask;
+			for (int i = 0; i < n; ++i) {
+				const Lanes comb_output = {
+					history[(position - sizes[0]) & mask][0],
+					history[(position - sizes[1]) & mask][1],
+					history[(position - sizes[2]) & mask][2],
+					history[(position - sizes[3]) & mask][3],
+					history[(position - sizes[4]) & mask][4],
+					history[(position - sizes[5]) & mask][5],
+					history[(position - sizes[6]) & mask][6],
+					history[(position - sizes[7]) & mask][7]
+				};
+				// low-pass filter
+				const float damping = damp[i] * .4f;
+				const Lanes filtered = comb_output * (1.f - damping) + previous * damping;
+				previous = filtered;
+				history[position] = input[i] * .03f + filtered * (room_size[i] * .28f + .7f);
+				position = (position + 1) & mask;
+				float result = 0.f;
+				for (int lane = 0; lane < 8; ++lane) {
+					result += comb_output[lane];
+				}
+				output[i] = result;
+			}
+			this->previous = previous;
+			this->position = position;
+		}
+		void clear() {
+			std::fill(history.begin(), history.end(), 0.f);
+			previous = Lanes{};
+		}
+		template <class Archive> void serialize(Archive& archive) {
+			archive(history, position);
+			// as floats, since a reference to the less aligned vector type would lose its alignment
+			archive.array(reinterpret_cast<float*>(&previous), 8);
 		}
 	};
-	template <std::size_t N> class AllPass {
-		std::array<float, N> buffer;
+	class AllPass {
+		std::size_t size;
+		std::size_t mask;
+		std::vector<float> history;
 		std::size_t position;
 	public:
-		AllPass(): buffer(), position(0) {}
-		float process(float input) {
+		AllPass(std::size_t size): size(scale_to_sample_rate(size)), mask(power_of_two_above(this->size) - 1), history(mask + 1), position(0) {}
+		void process_block(float* data, int n) {
 			constexpr float feedback = .5f;
-			const float output = buffer[position];
-			buffer[position] = input + output * feedback;
-			position = (position + 1) % N;
-			return output - input;
+			std::size_t position = this->position;
+			float* history = this->history.data();
+			for (int i = 0; i < n; ++i) {
+				const float output = history[(position - size) & mask];
+				history[position] = data[i] + output * feedback;
+				position = (position + 1) & mask;
+				data[i] = output - data[i];
+			}
+			this->position = position;
+		}
+		void clear() {
+			std::fill(history.begin(), history.end(), 0.f);
+		}
+		template <class Archive> void serialize(Archive& archive) {
+			archive(history, position);
 		}
 	};
-	template <std::size_t S> class Channel {
-		Comb<1116+S> comb1;
-		Comb<1188+S> comb2;
-		Comb<1277+S> comb3;
-		Comb<1356+S> comb4;
-		Comb<1422+S> comb5;
-		Comb<1491+S> comb6;
-		Comb<1557+S> comb7;
-		Comb<1617+S> comb8;
-		AllPass<556+S> all_pass1;
-		AllPass<441+S> all_pass2;
-		AllPass<341+S> all_pass3;
-		AllPass<225+S> all_pass4;
+	class Channel {
+		CombBank combs;
+		AllPass all_pass1;
+		AllPass all_pass2;
+		AllPass all_pass3;
+		AllPass all_pass4;
 	public:
-		float process(float input, float feedback, float damp) {
-			float result = 0.f;
+		Channel(std::size_t spread): combs(spread), all_pass1(556 + spread), all_pass2(441 + spread), all_pass3(341 + spread), all_pass4(225 + spread) {}
+		void process_block(const float* input, const float* room_size, const float* damp, float* output, int n) {
 			// process comb filters in parallel
-			result += comb1.process(input, feedback, damp);
-			result += comb2.process(input, feedback, damp);
-			result += comb3.process(input, feedback, damp);
-			result += comb4.process(input, feedback, damp);
-			result += comb5.process(input, feedback, damp);
-			result += comb6.process(input, feedback, damp);
-			result += comb7.process(input, feedback, damp);
-			result += comb8.process(input, feedback, damp);
+			combs.process_block(input, room_size, damp, output, n);
 			// process all-pass filters in series
-			result = all_pass1.process(result);
-			result = all_pass2.process(result);
-			result = all_pass3.process(result);
-			result = all_pass4.process(result);
-			return result;
+			all_pass1.process_block(output, n);
+			all_pass2.process_block(output, n);
+			all_pass3.process_block(output, n);
+			all_pass4.process_block(output, n);
+		}
+		void clear() {
+			combs.clear();
+			all_pass1.clear();
+			all_pass2.clear();
+			all_pass3.clear();
+			all_pass4.clear();
+		}
+		template <class Archive> void serialize(Archive& archive) {
+			archive(combs, all_pass1, all_pass2, all_pass3, all_pass4);
 		}
 	};
-	Channel<0> channel1;
-	Channel<23> channel2;
+	Channel channel1{0};
+	Channel channel2{23};
+	// the longest comb filter and the all-pass filters of the second channel, a silent output for that long
+	// means the reverb has died away (a heuristic, the comb filters could in theory cancel out)
+	std::size_t tail = scale_to_sample_rate(1617 + 556 + 441 + 341 + 225 + 5 * 23);
+	std::size_t quiet = 0; // silent samples of input and output in a row, up to tail
 public:
 	Sample process(float input, float room_size, float damp, float wet, float dry, float width) {
-		const float _input = input * .03f;
-		const float feedback = room_size * .28f + .7f;
-		damp = damp * .4f;
-		wet = wet * 3.f;
-		dry = dry * 2.f;
-		const float output1 = channel1.process(_input, feedback, damp);
-		const float output2 = channel2.process(_input, feedback, damp);
-		return Width::process(Sample(output1, output2), width) * wet + Sample(input) * dry;
+		Sample output;
+		process_block(&input, &room_size, &damp, &wet, &dry, &width, &output, 1);
+		return output;
+	}
+	void process_block(const float* input, const float* room_size, const float* damp, const float* wet, const float* dry, const float* width, Sample* output, int n) {
+		float output1[BLOCK_SIZE];
+		float output2[BLOCK_SIZE];
+		channel1.process_block(input, room_size, damp, output1, n);
+		channel2.process_block(input, room_size, damp, output2, n);
+		for (int i = 0; i < n; ++i) {
+			output[i] = Width::process(Sample(output1[i], output2[i]), width[i]) * (wet[i] * 3.f) + Sample(input[i]) * (dry[i] * 2.f);
+		}
+		int silent = 0;
+		while (silent < n && is_silent(input[n - 1 - silent]) && is_silent(output1[n - 1 - silent]) && is_silent(output2[n - 1 - silent])) {
+			++silent;
+		}
+		const std::size_t was_quiet = quiet;
+		quiet = silent == n ? std::min(quiet + n, tail) : silent;
+		// clear what is left of the reverb once it has died away, instead of letting it decay into denormals,
+		// which is cheaper than flushing every sample
+		if (quiet == tail && was_quiet < tail) {
+			channel1.clear();
+			channel2.clear();
+		}
+	}
+	int get_tail() const {
+		return tail - quiet;
+	}
+	template <class Archive> void serialize(Archive& archive) {
+		archive(channel1, channel2, quiet);
+	}
+};
+
+// convolution with a stereo impulse response, e.g. a measured room, given at the current sample rate
+// the first block of the response is applied directly, so there is no latency, and the rest by partitioned
+// FFT convolution (overlap-save with a frequency-domain delay line), in segments of partitions that grow
+// from one block up to max_partition samples: large partitions need far fewer operations for long responses,
+// but are computed all at once every max_partition samples, so realtime playback with long partitions
+// needs a lookahead (see ALSAOutput); max_partition = BLOCK_SIZE gives uniform partitions
+class Convolver {
+	using Lanes = Vector<float, 4>;
+	static constexpr int LANES = 4;
+	// one segment, uniformly partitioned into partitions of size samples that are transformed with 2 * size
+	// points; left + i * right is transformed at once, its real and imaginary parts are the two channels
+	class Segment {
+		FFT fft;
+		int size;
+		int partitions;
+		// per partition 2 * size real parts followed by 2 * size imaginary parts
+		std::vector<float> spectra; // of the impulse response, scaled by 1 / (2 * size)
+		std::vector<float> delay_line; // of the input windows, the newest at current
+		int current = 0;
+		std::vector<float> sum;
+	public:
+		// offset is where the segment starts in the impulse response, it has to be at least size for the
+		// output to be ready in time
+		const std::size_t offset;
+		Segment(int size, std::size_t offset, std::size_t end, const float* left, const float* right): fft(2 * size), size(size), partitions((end - offset + size - 1) / size), spectra(partitions * 4 * size), delay_line(partitions * 4 * size), sum(4 * size), offset(offset) {
+			for (int partition = 0; partition < partitions; ++partition) {
+				float* real = &spectra[partition * 4 * size];
+				float* imag = real + 2 * size;
+				for (int i = 0; i < size && offset + partition * size + i < end; ++i) {
+					real[i] = left[offset + partition * size + i] / (2 * size);
+					imag[i] = right[offset + partition * size + i] / (2 * size);
+				}
+				fft.forward(real, imag);
+			}
+		}
+		int get_size() const {
+			return size;
+		}
+		// convolves the partitions with the last 2 * size input samples and returns the size samples of
+		// output for the last size inputs, left followed by right
+		const float* process(const float* window) {
+			current = current == 0 ? partitions - 1 : current - 1;
+			float* input = &delay_line[current * 4 * size];
+			std::copy_n(window, 2 * size, input);
+			std::fill_n(input + 2 * size, 2 * size, 0.f);
+			fft.forward(input, input + 2 * size);
+			// complex multiply-accumulate of the spectra, LANES bins at a time
+			Lanes* real = reinterpret_cast<Lanes*>(sum.data());
+			Lanes* imag = real + 2 * size / LANES;
+			std::fill(sum.begin(), sum.end(), 0.f);
+			for (int partition = 0; partition < partitions; ++partition) {
+				const int delayed = (current + partition) % partitions;
+				const Lanes* x_real = reinterpret_cast<const Lanes*>(&delay_line[delayed * 4 * size]);
+				const Lanes* x_imag = x_real + 2 * size / LANES;
+				const Lanes* h_real = reinterpret_cast<const Lanes*>(&spectra[partition * 4 * size]);
+				const Lanes* h_imag = h_real + 2 * size / LANES;
+				for (int i = 0; i < 2 * size / LANES; ++i) {
+					real[i] += x_real[i] * h_real[i] - x_imag[i] * h_imag[i];
+					imag[i] += x_real[i] * h_imag[i] + x_imag[i] * h_real[i];
+				}
+			}
+			fft.forward(sum.data() + 2 * size, sum.data());
+			// overlap-save: the first half wrapped around, left is in the real and right in the imaginary half
+			std::copy_n(sum.data() + 3 * size, size, sum.data() + 2 * size);
+			return sum.data() + size;
+		}
+		// the spectra of the response are settings and sum is recomputed every time
+		template <class Archive> void serialize(Archive& archive) {
+			archive(delay_line, current);
+		}
+	};
+	std::size_t length;
+	float head_left[BLOCK_SIZE] = {}; // the first block of the impulse response, reversed
+	float head_right[BLOCK_SIZE] = {};
+	std::vector<Segment> segments;
+	// the input, every sample stored twice like in DelayLine, so that windows of the last samples are contiguous
+	std::vector<float> history;
+	std::size_t history_mask;
+	std::size_t position = 0;
+	// the output of the segments, added to the output at their frames
+	std::vector<float> tail_left;
+	std::vector<float> tail_right;
+	std::size_t tail_mask;
+	std::size_t frame = 0;
+	std::size_t quiet = 0; // silent input samples in a row, up to length
+public:
+	Convolver(const std::vector<float>& left, const std::vector<float>& right, std::size_t max_partition = 4096): length(std::max(left.size(), right.size())) {
+		std::vector<float> left_padded(left);
+		std::vector<float> right_padded(right);
+		left_padded.resize(length);
+		right_padded.resize(length);
+		for (std::size_t i = 0; i < std::min<std::size_t>(length, BLOCK_SIZE); ++i) {
+			head_left[BLOCK_SIZE - 1 - i] = left_padded[i];
+			head_right[BLOCK_SIZE - 1 - i] = right_padded[i];
+		}
+		// a segment of partition size can hand over to one of 4 * size once it reaches 4 * size
+		std::size_t offset = BLOCK_SIZE;
+		std::size_t size = BLOCK_SIZE;
+		while (offset < length) {
+			const std::size_t end = size * 4 <= max_partition ? std::min(length, size * 4) : length;
+			segments.emplace_back(size, offset, end, left_padded.data(), right_padded.data());
+			offset = end;
+			size *= 4;
+		}
+		const std::size_t largest = segments.empty() ? BLOCK_SIZE : segments.back().get_size();
+		history_mask = power_of_two_above(2 * largest) - 1;
+		history.resize(2 * (history_mask + 1));
+		tail_mask = power_of_two_above(segments.empty() ? BLOCK_SIZE : segments.back().offset + largest) - 1;
+		tail_left.resize(tail_mask + 1);
+		tail_right.resize(tail_mask + 1);
+	}
+	Sample process(float input, float wet, float dry) {
+		Sample output;
+		process_block(&input, &wet, &dry, &output, 1);
+		return output;
+	}
+	void process_block(const float* input, const float* wet, const float* dry, Sample* output, int n) {
+		const std::size_t size = history_mask + 1;
+		for (int i = 0; i < n;) {
+			// up to the next multiple of the block size, where segments may have to run
+			const int chunk = std::min<int>(n - i, BLOCK_SIZE - frame % BLOCK_SIZE);
+			for (int j = i; j < i + chunk; ++j) {
+				history[position] = input[j];
+				history[position + size] = input[j];
+				position = (position + 1) & history_mask;
+				// the head, LANES taps at a time
+				const Lanes* window = reinterpret_cast<const Lanes*>(&history[(position - BLOCK_SIZE) & history_mask]);
+				const Lanes* taps_left = reinterpret_cast<const Lanes*>(head_left);
+				const Lanes* taps_right = reinterpret_cast<const Lanes*>(head_right);
+				Lanes sum_left = {};
+				Lanes sum_right = {};
+				for (int k = 0; k < BLOCK_SIZE / LANES; ++k) {
+					sum_left += window[k] * taps_left[k];
+					sum_right += window[k] * taps_right[k];
+				}
+				const std::size_t tail = frame & tail_mask;
+				float left = tail_left[tail];
+				float right = tail_right[tail];
+				tail_left[tail] = 0.f;
+				tail_right[tail] = 0.f;
+				for (int lane = 0; lane < LANES; ++lane) {
+					left += sum_left[lane];
+					right += sum_right[lane];
+				}
+				output[j] = Sample(left, right) * wet[j] + Sample(input[j]) * dry[j];
+				++frame;
+			}
+			if (frame % BLOCK_SIZE == 0) {
+				for (Segment& segment: segments) {
+					const std::size_t segment_size = segment.get_size();
+					if (frame % segment_size == 0) {
+						const float* result = segment.process(&history[(position - 2 * segment_size) & history_mask]);
+						// the output for the inputs from frame - segment_size on is due offset samples later
+						const std::size_t start = frame - segment_size + segment.offset;
+						for (std::size_t k = 0; k < segment_size; ++k) {
+							tail_left[(start + k) & tail_mask] += result[k];
+							tail_right[(start + k) & tail_mask] += result[segment_size + k];
+						}
+					}
+				}
+			}
+			i += chunk;
+		}
+		int silent = 0;
+		while (silent < n && is_silent(input[n - 1 - silent])) {
+			++silent;
+		}
+		quiet = silent == n ? std::min(quiet + n, length) : silent;
+	}
+	// the impulse response is over once the input has been silent for its length
+	int get_tail() const {
+		return length - quiet;
+	}
+	template <class Archive> void serialize(Archive& archive) {
+		archive(segments, history, position, tail_left, tail_right, frame, quiet);
 	}
 };
 
+// "0 .9/.01 .3/.2 0/.4": jump to 0, ramp linearly to .9 in .01 seconds, to .3 in .2 seconds and to 0 in .4 seconds
+// "0 1/.01 0^.5": like above, but decay exponentially to 0 in .5 seconds
+// strings are compiled into segment tables once and shared between all instances
 class Automation {
-	const char* automation;
-	const char* cursor;
-	float value;
-	float delta;
-	int t;
-	float parse_number() {
+	// value = start + position * step + scale * (1 - ratio ^ position)
+	struct Segment {
+		float start;
+		float step;
+		float scale;
+		float ratio;
+		int frames;
+	};
+	static constexpr float CURVATURE = 5.f;
+	static constexpr int HOLD = 1 << 30;
+	static float parse_number(const char*& cursor) {
 		float number = 0.f;
 		float sign = 1.f;
 		if (*cursor == '-') {
@@ -434,42 +2120,133 @@ class Automation {
 		}
 		return number * sign;
 	}
-	void skip_space() {
-		while (*cursor == ' ') {
-			++cursor;
+	static const Segment* compile(const char* automation) {
+		static std::mutex mutex;
+		static std::map<std::pair<float, std::string>, std::vector<Segment>> cache;
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto key = std::make_pair(get_sample_rate(), std::string(automation));
+		auto i = cache.find(key);
+		if (i != cache.end()) {
+			return i->second.data();
+		}
+		std::vector<Segment> segments;
+		float value = 0.f;
+		const char* cursor = automation;
+		while (*cursor != '\0') {
+			const float target = parse_number(cursor);
+			Segment segment = {target, 0.f, 0.f, 1.f, 1};
+			if (*cursor == '/' || *cursor == '^') {
+				const bool exponential = *cursor == '^';
+				++cursor;
+				const int frames = parse_number(cursor) / DT;
+				if (frames > 0) {
+					segment.start = value;
+					segment.frames = frames;
+					if (exponential) {
+						segment.scale = (target - value) / (1.f - std::exp(-CURVATURE));
+						segment.ratio = std::exp(-CURVATURE / frames);
+					}
+					else {
+						segment.step = (target - value) / frames;
+					}
+				}
+			}
+			segments.push_back(segment);
+			value = target;
+			while (*cursor == ' ') {
+				++cursor;
+			}
+		}
+		// the last segment holds the final value and is repeated forever
+		segments.push_back({value, 0.f, 0.f, 1.f, HOLD});
+		return cache.emplace(key, std::move(segments)).first->second.data();
+	}
+	const Segment* segments;
+	const Segment* segment;
+	Segment current;
+	int stride; // frames per call
+	int position;
+	float factor; // ratio ^ position
+	float factor_stride; // ratio ^ stride
+	// process carries the value from call to call instead of evaluating the segment, like the original parser
+	float value; // at position
+	float delta; // step * stride
+	bool exponential; // scale != 0
+	void update() {
+		value = current.start + position * current.step + current.scale * (1.f - factor);
+		delta = current.step * stride;
+		exponential = current.scale != 0.f;
+	}
+	// enters the next segment when position has passed the current one
+	void advance() {
+		while (position >= current.frames) {
+			position -= current.frames;
+			if (segment->frames != HOLD) {
+				++segment;
+			}
+			current = *segment;
+			factor = position == 0 ? 1.f : std::pow(current.ratio, position);
+			factor_stride = stride == 1 ? current.ratio : std::pow(current.ratio, stride);
+			update();
 		}
 	}
 public:
-	Automation(const char* automation): automation(automation), cursor(automation), value(0.f), delta(0.f), t(1) {}
+	// with a stride of K, every call advances K frames, e.g. for an Automation behind a ControlRate<float, K>
+	Automation(const char* automation, int stride = 1): segments(compile(automation)), stride(stride) {
+		reset();
+	}
 	float process() {
-		value += delta;
-		--t;
-		if (t == 0) {
-			if (*cursor != '\0') {
-				const float new_value = parse_number();
-				if (*cursor == '/') {
-					++cursor;
-					t = parse_number() / DT;
-					delta = (new_value - value) / t;
-				}
-				else {
-					value = new_value;
-					delta = 0.f;
-					t = 1;
+		if (position >= current.frames) {
+			advance();
+		}
+		const float result = value;
+		if (exponential) {
+			factor *= factor_stride;
+			value = current.start + current.scale * (1.f - factor);
+		}
+		else {
+			value += delta;
+		}
+		position += stride;
+		return result;
+	}
+	void process_block(float* output, int n) {
+		for (int i = 0; i < n;) {
+			advance();
+			const int size = std::min(n - i, (current.frames - position + stride - 1) / stride);
+			const float start = current.start;
+			if (current.scale != 0.f) {
+				const float scale = current.scale;
+				const float ratio = factor_stride;
+				for (int j = 0; j < size; ++j) {
+					output[i + j] = start + scale * (1.f - factor);
+					factor *= ratio;
 				}
-				skip_space();
 			}
 			else {
-				delta = 0.f;
+				// independent lanes, so the compiler can vectorize this
+				const float step = current.step;
+				const int offset = position;
+				for (int j = 0; j < size; ++j) {
+					output[i + j] = start + (offset + j * stride) * step;
+				}
 			}
+			position += size * stride;
+			i += size;
 		}
-		return value;
+		update();
 	}
 	void reset() {
-		cursor = automation;
-		value = 0.f;
-		delta = 0.f;
-		t = 1;
+		segment = segments;
+		current = *segment;
+		position = 0;
+		factor = 1.f;
+		factor_stride = stride == 1 ? current.ratio : std::pow(current.ratio, stride);
+		update();
+	}
+	// done once it holds a silent final value
+	int get_tail() const {
+		return current.frames == HOLD && is_silent(current.start) ? 0 : 1;
 	}
 };
 
@@ -498,6 +2275,67 @@ struct MIDIEvent {
 		return status & 0x0F;
 	}
 };
+constexpr bool is_silent(MIDIEvent event) {
+	return !event;
+}
+
+// all MIDI events of one frame
+class MIDIEvents {
+	std::array<MIDIEvent, 16> events;
+	uchar size;
+public:
+	MIDIEvents(): size(0) {}
+	MIDIEvents(MIDIEvent event): size(0) {
+		add(event);
+	}
+	// events beyond the capacity are dropped
+	void add(MIDIEvent event) {
+		if (event && size < events.size()) {
+			events[size] = event;
+			++size;
+		}
+	}
+	const MIDIEvent* begin() const {
+		return events.data();
+	}
+	const MIDIEvent* end() const {
+		return events.data() + size;
+	}
+	bool is_empty() const {
+		return size == 0;
+	}
+};
+inline bool is_silent(const MIDIEvents& events) {
+	return events.is_empty();
+}
+
+// MIDIEvents as one MIDIEvent per frame, for the processors that take a MIDIEvent like Frequency and ADSR
+// events of the same frame are passed on in their order on consecutive frames (events beyond the capacity are dropped)
+class OneEventPerFrame {
+	std::array<MIDIEvent, 64> queue;
+	uchar first = 0;
+	uchar size = 0;
+public:
+	MIDIEvent process(MIDIEvents events) {
+		for (MIDIEvent event: events) {
+			if (size < queue.size()) {
+				queue[(first + size) % queue.size()] = event;
+				++size;
+			}
+		}
+		if (size == 0) {
+			return MIDIEvent();
+		}
+		const MIDIEvent event = queue[first];
+		first = (first + 1) % queue.size();
+		--size;
+		return event;
+	}
+	// done while nothing is queued, a Node2<OneEventPerFrame> then sleeps until the next events
+	int get_tail() const {
+		return size == 0 ? 0 : std::numeric_limits<int>::max();
+	}
+};
 
 class Note {
 public:
@@ -562,9 +2400,9 @@ public:
 		if (event.is_note_on()) {
 			const bool slide = note;
 			note = event.data1;
-			target_frequency = 440.f * std::pow(2.f, (note-69)/12.f);
+			target_frequency = 440.f * fast_exp2((note-69)/12.f);
 			if (slide) {
-				factor = std::pow(target_frequency / frequency, DT / 0.05f);
+				factor = fast_pow(target_frequency / frequency, DT / 0.05f);
 			}
 			else {
 				frequency = target_frequency;
@@ -600,6 +2438,10 @@ class NotePattern {
 	int t;
 public:
 	NotePattern(uchar note, const char* pattern): note(note), pattern(pattern), t(0) {}
+	// in steps of 6 ticks
+	int get_length() const {
+		return std::char_traits<char>::length(pattern);
+	}
 	MIDIEvent process(MIDIEvent clock) {
 		MIDIEvent event;
 		if (clock.status == 0xF8) {
@@ -648,6 +2490,112 @@ public:
 	}
 };
 
+// plays NotePatterns from a looping timeline of events that is compiled in advance
+// like MIDIClock, there are 24 ticks per beat and the first tick is on the first frame
+// events on the same tick are delivered together and tempo changes only rescale the time to the next event
+// process_block reads the tempo once per block
+// it outputs MIDIEvents, which Voices takes, other instruments take them through a Node2<OneEventPerFrame>
+class Sequencer {
+	struct Event {
+		int tick;
+		MIDIEvent event;
+	};
+	std::vector<Event> events;
+	int loop = 0; // length of the timeline in ticks
+	std::size_t index = 0; // next event
+	long cycle = 0;
+	// the tick position is anchored at a frame and advances by increment per frame
+	double anchor_tick = 0.0;
+	long anchor_frame = 0;
+	double increment = 0.0;
+	float bpm = 0.f;
+	long frame = 0;
+	long next_frame;
+	static int gcd(int a, int b) {
+		return b == 0 ? a : gcd(b, a % b);
+	}
+	void schedule() {
+		if (events.empty() || increment <= 0.0) {
+			next_frame = std::numeric_limits<long>::max();
+			return;
+		}
+		// the frame on which the tick position first passes the event
+		const double tick = static_cast<double>(cycle) * loop + events[index].tick;
+		next_frame = anchor_frame + static_cast<long>(std::floor((tick - anchor_tick) / increment));
+		// after a tempo change the rounded anchor can be past an event that is due now, which is then played now
+		// instead of on the previous frame
+		next_frame = std::max(next_frame, frame);
+	}
+	void set_tempo(float bpm) {
+		anchor_tick += (frame - anchor_frame) * increment;
+		anchor_frame = frame;
+		increment = bpm / 60.0 * 24.0 * DT;
+		this->bpm = bpm;
+		schedule();
+	}
+	MIDIEvent take() {
+		const MIDIEvent event = events[index].event;
+		++index;
+		if (index == events.size()) {
+			index = 0;
+			++cycle;
+		}
+		schedule();
+		return event;
+	}
+public:
+	Sequencer(std::initializer_list<NotePattern> patterns) {
+		loop = 1;
+		for (const NotePattern& pattern: patterns) {
+			const int length = pattern.get_length() * 6;
+			if (length > 0) {
+				loop = loop / gcd(loop, length) * length;
+			}
+		}
+		// run the patterns for one loop and record their events
+		for (NotePattern pattern: patterns) {
+			if (pattern.get_length() == 0) {
+				continue;
+			}
+			for (int tick = 0; tick < loop; ++tick) {
+				const MIDIEvent event = pattern.process(MIDIEvent(0xF8, 0, 0));
+				if (event) {
+					events.push_back({tick, event});
+				}
+			}
+		}
+		std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+			return a.tick < b.tick;
+		});
+		schedule();
+	}
+	MIDIEvents process(float bpm) {
+		if (bpm != this->bpm) {
+			set_tempo(bpm);
+		}
+		MIDIEvents result;
+		while (next_frame <= frame) {
+			result.add(take());
+		}
+		++frame;
+		return result;
+	}
+	void process_block(const float* bpm, MIDIEvents* output, int n) {
+		if (bpm[0] != this->bpm) {
+			set_tempo(bpm[0]);
+		}
+		std::fill_n(output, n, MIDIEvents());
+		while (next_frame < frame + n) {
+			output[next_frame - frame].add(take());
+		}
+		frame += n;
+	}
+	// the timeline is a setting
+	template <class Archive> void serialize(Archive& archive) {
+		archive(index, cycle, anchor_tick, anchor_frame, increment, bpm, frame, next_frame);
+	}
+};
+
 class ADSR {
 	enum class State {
 		Attack,
@@ -658,8 +2606,27 @@ class ADSR {
 	State state = State::Sustain;
 	float value = 0.f;
 	uchar note = 0;
+	// coefficients, recomputed when the corresponding parameter changes, NaN so that the first call computes them
+	float attack = std::numeric_limits<float>::quiet_NaN();
+	float attack_step = 0.f;
+	float decay = std::numeric_limits<float>::quiet_NaN();
+	float decay_factor = 0.f;
+	float release = std::numeric_limits<float>::quiet_NaN();
+	float release_step = 0.f;
 public:
 	float process(MIDIEvent event, float attack, float decay, float sustain, float release) {
+		if (attack != this->attack) {
+			this->attack = attack;
+			attack_step = 1000.f / attack * DT;
+		}
+		if (decay != this->decay) {
+			this->decay = decay;
+			decay_factor = fast_pow(0.01f, DT * 1000.f / decay);
+		}
+		if (release != this->release) {
+			this->release = release;
+			release_step = 1000.f / release * DT;
+		}
 		if (event.is_note_on()) {
 			const bool slide = note;
 			note = event.data1;
@@ -673,19 +2640,19 @@ public:
 		}
 		switch (state) {
 		case State::Attack:
-			value += 1000.f / attack * DT;
+			value += attack_step;
 			if (value >= 1.f) {
 				value = 1.f;
 				state = State::Decay;
 			}
 			break;
 		case State::Decay:
-			value = sustain + (value - sustain) * std::pow(0.01f, DT * 1000.f / decay);
+			value = flush_denormal(sustain + (value - sustain) * decay_factor);
 			break;
 		case State::Sustain:
 			break;
 		case State::Release:
-			value -= 1000.f / release * DT;
+			value -= release_step;
 			if (value <= 0.f) {
 				value = 0.f;
 				state = State::Sustain;
@@ -694,39 +2661,425 @@ public:
 		}
 		return value;
 	}
+	// done once the envelope has settled at silence, a Node2<ADSR> then sleeps until the next MIDI event
+	int get_tail() const {
+		return state != State::Attack && is_silent(value) ? 0 : std::numeric_limits<int>::max();
+	}
+};
+
+// polyphony: every lane of a vector holds one voice
+template <std::size_t N> struct VoiceState {
+	Vector<float, N> frequency;
+	Vector<float, N> velocity;
+	Vector<int, N> gate; // -1 while the key is held
+	Vector<int, N> trigger; // -1 on the sample the voice is started
+};
+
+template <std::size_t N> class PolyOsc {
+	Vector<float, N> sin = {};
+	Vector<float, N> cos = broadcast<Vector<float, N>>(1.f);
+public:
+	Vector<float, N> process(const Vector<float, N>& frequency) {
+		const Vector<float, N> f = frequency * (2.f * PI * DT);
+		cos += -sin * f;
+		sin += cos * f;
+		return sin;
+	}
+};
+
+template <std::size_t N> class PolySaw {
+	using Floats = Vector<float, N>;
+	Floats value = {};
+public:
+	Floats process(const Floats& frequency) {
+		value += frequency * (2.f * DT);
+		value -= select(less<Vector<int, N>>(broadcast<Floats>(1.f), value), broadcast<Floats>(2.f), Floats{});
+		return value;
+	}
+};
+
+template <std::size_t N> class PolySquare {
+	using Floats = Vector<float, N>;
+	Floats value = {};
+public:
+	Floats process(const Floats& frequency) {
+		value += frequency * DT;
+		value -= select(less<Vector<int, N>>(broadcast<Floats>(1.f), value), broadcast<Floats>(1.f), Floats{});
+		return select(less<Vector<int, N>>(broadcast<Floats>(.5f), value), broadcast<Floats>(1.f), broadcast<Floats>(-1.f));
+	}
+};
+
+// WavetableOsc for N voices: the table lookups are done per lane, the rest in vector lanes
+template <std::size_t N> class PolyWavetableOsc {
+	using Floats = Vector<float, N>;
+	using Ints = Vector<int32_t, N>;
+	using Uints = Vector<uint32_t, N>;
+	const Wavetable* wavetable;
+	Uints phase = {};
+	Floats frequency = {};
+	Uints increment = {};
+	Floats scale; // the size of the table divided by 2^24
+	std::array<const float*, N> tables;
+public:
+	explicit PolyWavetableOsc(const Wavetable& wavetable = Wavetable::saw()): wavetable(&wavetable) {
+		scale = broadcast<Floats>((1 << Wavetable::get_bits(Wavetable::LEVELS - 1)) / 16777216.f);
+		tables.fill(wavetable.get_table(Wavetable::LEVELS - 1));
+	}
+	Floats process(const Floats& frequency) {
+		if (std::memcmp(&frequency, &this->frequency, sizeof(Floats)) != 0) {
+			this->frequency = frequency;
+			for (std::size_t i = 0; i < N; ++i) {
+				increment[i] = Wavetable::get_increment(frequency[i]);
+				const int level = Wavetable::get_level(increment[i]);
+				scale[i] = (1 << Wavetable::get_bits(level)) / 16777216.f;
+				tables[i] = wavetable->get_table(level);
+			}
+		}
+		// the position in the tables from the top 24 bits of the phase, vector shifts by a different amount
+		// per lane would be done one lane at a time without AVX2
+		const Floats position = __builtin_convertvector(phase >> 8, Floats) * scale;
+		const Ints index = __builtin_convertvector(position, Ints);
+		Floats a, b;
+		for (std::size_t i = 0; i < N; ++i) {
+			a[i] = tables[i][index[i]];
+			b[i] = tables[i][index[i] + 1];
+		}
+		phase += increment;
+		return a + (b - a) * (position - __builtin_convertvector(index, Floats));
+	}
+};
+
+template <std::size_t N> class PolyADSR {
+	using Floats = Vector<float, N>;
+	using Mask = Vector<int, N>;
+	// one mask per state, a voice in none of them is in the sustain state
+	Mask attack_state = {};
+	Mask decay_state = {};
+	Mask release_state = {};
+	Floats value = {};
+	// coefficients, recomputed when the corresponding parameter changes, NaN so that the first call computes them
+	float attack = std::numeric_limits<float>::quiet_NaN();
+	float attack_step = 0.f;
+	float decay = std::numeric_limits<float>::quiet_NaN();
+	float decay_factor = 0.f;
+	float release = std::numeric_limits<float>::quiet_NaN();
+	float release_step = 0.f;
+public:
+	Floats process(const VoiceState<N>& voices, float attack, float decay, float sustain, float release) {
+		if (attack != this->attack) {
+			this->attack = attack;
+			attack_step = 1000.f / attack * DT;
+		}
+		if (decay != this->decay) {
+			this->decay = decay;
+			decay_factor = fast_pow(0.01f, DT * 1000.f / decay);
+		}
+		if (release != this->release) {
+			this->release = release;
+			release_step = 1000.f / release * DT;
+		}
+		attack_state |= voices.trigger;
+		decay_state &= ~voices.trigger;
+		release_state &= ~voices.trigger;
+		release_state |= ~voices.gate & (attack_state | decay_state);
+		attack_state &= voices.gate;
+		decay_state &= voices.gate;
+		const Floats attack_value = value + attack_step;
+		const Floats decay_value = flush_denormals(sustain + (value - sustain) * decay_factor);
+		const Floats release_value = value - release_step;
+		value = select(attack_state, attack_value, select(decay_state, decay_value, select(release_state, release_value, value)));
+		const Mask attack_done = attack_state & ~less<Mask>(value, broadcast<Floats>(1.f));
+		value = select(attack_done, broadcast<Floats>(1.f), value);
+		attack_state &= ~attack_done;
+		decay_state |= attack_done;
+		const Mask release_done = release_state & ~less<Mask>(Floats{}, value);
+		value = select(release_done, Floats{}, value);
+		release_state &= ~release_done;
+		return value;
+	}
+};
+
+// allocates the voices of a polyphonic processor T from MIDI events and mixes them
+// T::process takes a const VoiceState<N>& followed by its other inputs and returns a Vector<float, N>
+// N = NATIVE_LANES keeps every voice vector in one register, more voices are best a multiple of it
+template <class T, std::size_t N, class Arguments = NodeInfo::argument_types<T>> class Voices;
+template <class T, std::size_t N, class Arg0, class... Arg> class Voices<T, N, TypeList<Arg0, Arg...>> {
+	VoiceState<N> state;
+	std::array<uchar, N> notes; // 0 if the voice is free
+	std::array<uint, N> ages; // time of the last note-on or note-off
+	uint time;
+	void note_on(uchar note, uchar velocity) {
+		std::size_t voice = N;
+		for (std::size_t i = 0; i < N; ++i) {
+			if (notes[i] == note) {
+				voice = i;
+				break;
+			}
+			// prefer the longest released voice, otherwise steal the oldest one
+			if (voice == N || (notes[i] == 0) > (notes[voice] == 0) || ((notes[i] == 0) == (notes[voice] == 0) && ages[i] < ages[voice])) {
+				voice = i;
+			}
+		}
+		notes[voice] = note;
+		ages[voice] = ++time;
+		state.frequency[voice] = 440.f * fast_exp2((note-69)/12.f);
+		state.velocity[voice] = velocity / 127.f;
+		state.gate[voice] = -1;
+		state.trigger[voice] = -1;
+	}
+	void note_off(uchar note) {
+		for (std::size_t i = 0; i < N; ++i) {
+			if (notes[i] == note) {
+				notes[i] = 0;
+				ages[i] = ++time;
+				state.gate[i] = 0;
+			}
+		}
+	}
+public:
+	T voice;
+	Voices(): state(), notes(), ages(), time(0) {}
+	template <class Archive> void serialize(Archive& archive) {
+		archive(state, notes, ages, time, voice);
+	}
+	float process(MIDIEvents events, Arg... arguments) {
+		float output;
+		process_block(&events, &arguments..., &output, 1);
+		return output;
+	}
+	// the voices are mixed once per block, as a sum over the lanes of all samples
+	void process_block(const MIDIEvents* events, const Arg*... arguments, float* output, int n) {
+		Vector<float, N> outputs[BLOCK_SIZE];
+		for (int i = 0; i < n; ++i) {
+			if (!events[i].is_empty()) {
+				for (MIDIEvent event: events[i]) {
+					if (event.is_note_on()) {
+						note_on(event.data1, event.data2);
+					}
+					else if (event.is_note_off()) {
+						note_off(event.data1);
+					}
+				}
+			}
+			outputs[i] = voice.process(state, arguments[i]...);
+			// the triggers of the note ons last for one sample
+			state.trigger = Vector<int, N>{};
+		}
+		const float* lanes = reinterpret_cast<const float*>(outputs);
+		for (int i = 0; i < n; ++i) {
+			float sum = 0.f;
+			for (std::size_t lane = 0; lane < N; ++lane) {
+				sum += lanes[i * N + lane];
+			}
+			output[i] = sum;
+		}
+	}
+};
+
+// states of a graph saved at regular times while rendering, so that a later render can start anywhere by loading
+// the last state before it and rendering only from there, e.g. to listen to a section of a long song again
+// states are saved at block starts that are multiples of interval frames after the first frame; when the graph
+// is changed from some time on, discard the states after that time
+// every state is a full copy of the graph's buffers, delay lines and convolution histories included, so a save
+// costs about as much as writing that much fresh memory (for the song in examples/benchmark.cc 0.9 MB, 0.4 ms)
+class Checkpoints {
+	int interval;
+	std::map<int, std::vector<char>> states; // by the frame they were saved before
+public:
+	explicit Checkpoints(float seconds = 10.f): interval(std::max(1, int(seconds * get_sample_rate()) / BLOCK_SIZE) * BLOCK_SIZE) {}
+	// saves the state of output before frame t if a checkpoint is due, called by WAVOutput::render
+	void update(Output<Sample>& output, int t) {
+		if ((t - 1) % interval != 0 || states.count(t)) {
+			return;
+		}
+		// states have about the same size every time, so the buffer is allocated once instead of growing
+		std::vector<char> state;
+		if (!states.empty()) {
+			state.reserve(states.rbegin()->second.size());
+		}
+		if (StateArchive::save(output, state)) {
+			states[t] = std::move(state);
+		}
+	}
+	// brings output to where it was before frame t, returns false if there is no state before t or it doesn't fit
+	// t should be a block start (1 plus a multiple of BLOCK_SIZE), otherwise the following blocks differ from those
+	// of a render from the beginning, which changes what nodes sleep through
+	bool restore(Output<Sample>& output, int t) {
+		auto state = states.upper_bound(t);
+		if (state == states.begin()) {
+			return false;
+		}
+		--state;
+		if (!StateArchive::load(output, state->second)) {
+			return false;
+		}
+		DenormalGuard guard;
+		Sample block[BLOCK_SIZE];
+		for (int frame = state->first; frame < t; frame += BLOCK_SIZE) {
+			output.get_block(frame, block, std::min(BLOCK_SIZE, t - frame));
+		}
+		return true;
+	}
+	void discard(int t) {
+		states.erase(states.upper_bound(t), states.end());
+	}
+	std::size_t get_count() const {
+		return states.size();
+	}
+	// in bytes
+	std::size_t get_size() const {
+		std::size_t size = 0;
+		for (const auto& state: states) {
+			size += state.second.size();
+		}
+		return size;
+	}
 };
 
+// streams stereo audio to a WAV file, the sizes in the header are filled in by close()
 class WAVOutput {
+public:
+	enum Format {
+		S16,
+		S24,
+		FLOAT
+	};
+private:
+	static constexpr std::size_t BUFFER_SIZE = 1 << 16;
 	std::ofstream file;
+	Format format;
+	bool dither;
+	Xorshift128plus random;
+	std::vector<char> buffer;
+	uint64_t frames = 0;
+	int t = 1;
 	template <class T> void write(T data) {
 		file.write(reinterpret_cast<const char*>(&data), sizeof(T));
 	}
 	void write_tag(const char* tag) {
 		file.write(tag, 4);
 	}
-public:
-	WAVOutput(const char* file_name): file(file_name, std::ios_base::binary) {}
-	void run(Output<Sample>& input, int frames) {
+	int get_bytes_per_frame() const {
+		return format == S16 ? 4 : (format == S24 ? 6 : 8);
+	}
+	void write_header() {
+		const uint64_t data_size = frames * get_bytes_per_frame();
+		const uint32_t header_size = format == FLOAT ? 50 : 36;
 		write_tag("RIFF");
-		write<uint32_t>(36 + frames * 2 * 2);
+		write<uint32_t>(std::min<uint64_t>(header_size + data_size, 0xFFFFFFFF));
 		write_tag("WAVE");
 
 		write_tag("fmt ");
-		write<uint32_t>(16); // fmt chunk size
-		write<uint16_t>(1); // format
+		write<uint32_t>(format == FLOAT ? 18 : 16); // fmt chunk size
+		write<uint16_t>(format == FLOAT ? 3 : 1); // format
 		write<uint16_t>(2); // channels
-		write<uint32_t>(44100); // sample rate
-		write<uint32_t>(44100 * 2 * 2); // bytes per second
-		write<uint16_t>(2 * 2); // bytes per frame
-		write<uint16_t>(16); // bits per sample
+		write<uint32_t>(get_sample_rate()); // sample rate
+		write<uint32_t>(get_sample_rate() * get_bytes_per_frame()); // bytes per second
+		write<uint16_t>(get_bytes_per_frame()); // bytes per frame
+		write<uint16_t>(get_bytes_per_frame() * 4); // bits per sample
+		if (format == FLOAT) {
+			write<uint16_t>(0); // extension size
+			write_tag("fact");
+			write<uint32_t>(4);
+			write<uint32_t>(std::min<uint64_t>(frames, 0xFFFFFFFF));
+		}
 
 		write_tag("data");
-		write<uint32_t>(frames * 2 * 2);
-		for (int t = 1; t <= frames; ++t) {
-			const Sample sample = input.get(t);
-			write<int16_t>(sample.left * 32767.f + .5f);
-			write<int16_t>(sample.right * 32767.f + .5f);
+		write<uint32_t>(std::min<uint64_t>(data_size, 0xFFFFFFFF));
+	}
+	void flush() {
+		file.write(buffer.data(), buffer.size());
+		buffer.clear();
+	}
+	// converts a block and appends it to the buffer
+	void convert(const Sample* input, int n) {
+		const float* samples = reinterpret_cast<const float*>(input);
+		const std::size_t offset = buffer.size();
+		buffer.resize(offset + n * get_bytes_per_frame());
+		char* output = buffer.data() + offset;
+		if (format == FLOAT) {
+			std::copy_n(samples, n * 2, reinterpret_cast<float*>(output));
+			return;
+		}
+		const float scale = format == S16 ? 32767.f : 8388607.f;
+		float values[BLOCK_SIZE * 2] = {};
+		if (dither) {
+			// triangular noise with an amplitude of one step
+			for (int i = 0; i < n * 2; ++i) {
+				const uint64_t r = random.get_next();
+				values[i] = (int64_t(r & 0xFFFFFFFF) - int64_t(r >> 32)) * (1.f / 4294967296.f);
+			}
+		}
+		int32_t integers[BLOCK_SIZE * 2];
+		for (int i = 0; i < n * 2; ++i) {
+			integers[i] = quantize(samples[i] * scale + values[i], scale);
 		}
+		if (format == S16) {
+			int16_t shorts[BLOCK_SIZE * 2];
+			std::copy_n(integers, n * 2, shorts);
+			std::copy_n(reinterpret_cast<const char*>(shorts), n * 4, output);
+		} else {
+			for (int i = 0; i < n * 2; ++i) {
+				output[i*3] = integers[i];
+				output[i*3+1] = integers[i] >> 8;
+				output[i*3+2] = integers[i] >> 16;
+			}
+		}
+	}
+public:
+	WAVOutput(const char* file_name, Format format = S16, bool dither = false): file(file_name, std::ios_base::binary), format(format), dither(dither) {
+		write_header();
+		buffer.reserve(BUFFER_SIZE);
+	}
+	~WAVOutput() {
+		close();
+	}
+	// renders the next frames, can be called repeatedly, saving checkpoints on the way if given
+	void render(Output<Sample>& input, int frames, Checkpoints* checkpoints = nullptr) {
+		DenormalGuard guard;
+		Sample block[BLOCK_SIZE];
+		for (int i = 0; i < frames; i += BLOCK_SIZE) {
+			const int n = std::min(BLOCK_SIZE, frames - i);
+			if (checkpoints) {
+				checkpoints->update(input, t);
+			}
+			input.get_block(t, block, n);
+			t += n;
+			append(block, n);
+		}
+	}
+	// writes already rendered samples
+	void append(const Sample* samples, int frames) {
+		for (int i = 0; i < frames; i += BLOCK_SIZE) {
+			convert(samples + i, std::min(BLOCK_SIZE, frames - i));
+			if (buffer.size() + BLOCK_SIZE * get_bytes_per_frame() > BUFFER_SIZE) {
+				flush();
+			}
+		}
+		this->frames += frames;
+	}
+	void close() {
+		if (!file.is_open()) {
+			return;
+		}
+		flush();
+		file.seekp(0);
+		write_header();
+		file.close();
+	}
+	// continues the rendering of input at frame t, rounded down to a block start, where input is restored to from
+	// checkpoints, so that a file can start in the middle of a song; returns false if input can't be restored
+	bool seek(Output<Sample>& input, int t, Checkpoints& checkpoints) {
+		t -= (t - 1) % BLOCK_SIZE;
+		if (!checkpoints.restore(input, t)) {
+			return false;
+		}
+		this->t = t;
+		return true;
+	}
+	void run(Output<Sample>& input, int frames, Checkpoints* checkpoints = nullptr) {
+		render(input, frames, checkpoints);
+		close();
 	}
 };
 
@@ -0,0 +1,394 @@
+/*
+
+Copyright (c) 2017, Elias Aebi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#pragma once
+
+#include "modo.hh"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace modo {
+
+// worker threads that run batches of tasks; idle workers claim the next unstarted task of the batch
+class ThreadPool {
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::function<void(int)> task;
+	int size = 0;
+	std::atomic<int> next{0};
+	std::atomic<int> done{0};
+	std::atomic<int> busy{0};
+	std::atomic<uint> generation{0};
+	std::atomic<bool> active{false}; // while a batch runs
+	bool quit = false;
+	void execute() {
+		for (int i = next.fetch_add(1); i < size; i = next.fetch_add(1)) {
+			task(i);
+			done.fetch_add(1, std::memory_order_release);
+		}
+	}
+	void work() {
+		DenormalGuard guard;
+		uint seen = 0;
+		while (true) {
+			// spin for a short while before going to sleep, batches usually come once per block
+			for (int i = 0; i < 1000 && generation.load(std::memory_order_acquire) == seen; ++i) {
+				std::this_thread::yield();
+			}
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [&]() {
+					return quit || generation != seen;
+				});
+				if (quit) {
+					return;
+				}
+				seen = generation;
+				++busy;
+			}
+			execute();
+			--busy;
+		}
+	}
+public:
+	ThreadPool(int threads = std::thread::hardware_concurrency()) {
+		// the calling thread is one of the workers
+		for (int i = 1; i < threads; ++i) {
+			this->threads.emplace_back([this]() {
+				work();
+			});
+		}
+	}
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		condition.notify_all();
+		for (std::thread& thread: threads) {
+			thread.join();
+		}
+	}
+	// calls task(i) for every i from 0 to size-1 and returns when all of them are done
+	// a batch started while another one runs, e.g. by a ParallelMix that is an input of a ParallelMix on the same
+	// pool, is run by the calling thread alone
+	void run(int size, std::function<void(int)> task) {
+		if (active.exchange(true, std::memory_order_acquire)) {
+			for (int i = 0; i < size; ++i) {
+				task(i);
+			}
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			// wait for workers that are still leaving the previous batch
+			while (busy != 0) {
+				std::this_thread::yield();
+			}
+			this->task = std::move(task);
+			this->size = size;
+			next = 0;
+			done = 0;
+			++generation;
+		}
+		condition.notify_all();
+		execute();
+		while (done.load(std::memory_order_acquire) < size) {
+			std::this_thread::yield();
+		}
+		active.store(false, std::memory_order_release);
+	}
+};
+
+// splits outputs into groups that share no nodes, so that the groups can be evaluated in parallel
+// an output that depends on an output which doesn't know its inputs may share any node, so it is grouped with
+// all other outputs
+inline std::vector<std::vector<std::size_t>> group_independent(const std::vector<Output<Sample>*>& outputs) {
+	std::vector<std::vector<const void*>> nodes(outputs.size());
+	for (std::size_t i = 0; i < outputs.size(); ++i) {
+		outputs[i]->get_nodes(nodes[i]);
+	}
+	auto is_unknown = [&](std::size_t output) {
+		return std::find(nodes[output].begin(), nodes[output].end(), nullptr) != nodes[output].end();
+	};
+	auto shares_nodes = [&](std::size_t output, const std::vector<std::size_t>& group) {
+		for (std::size_t i: group) {
+			if (is_unknown(output) || is_unknown(i)) {
+				return true;
+			}
+			for (const void* node: nodes[output]) {
+				if (std::find(nodes[i].begin(), nodes[i].end(), node) != nodes[i].end()) {
+					return true;
+				}
+			}
+		}
+		return false;
+	};
+	std::vector<std::vector<std::size_t>> groups;
+	for (std::size_t i = 0; i < outputs.size(); ++i) {
+		// merge all groups that share a node with this output
+		std::vector<std::size_t> group = {i};
+		for (auto j = groups.begin(); j != groups.end();) {
+			if (shares_nodes(i, *j)) {
+				group.insert(group.end(), j->begin(), j->end());
+				j = groups.erase(j);
+			}
+			else {
+				++j;
+			}
+		}
+		groups.push_back(group);
+	}
+	return groups;
+}
+
+// adds its inputs like a mixer, evaluating independent inputs in parallel
+// inputs that share a node are evaluated by the same task, so no node is touched by two threads
+// the sum is taken in the order the inputs were added, so the result matches a single-threaded mix
+class ParallelMix: public Output<Sample> {
+	ThreadPool& pool;
+	std::vector<Output<Sample>*> inputs;
+	std::vector<std::vector<std::size_t>> groups;
+	std::vector<std::array<Sample, BLOCK_SIZE>> buffers;
+	std::vector<char> silent; // per input, written by the workers
+	std::array<Sample, BLOCK_SIZE> values;
+	bool all_silent = false;
+	int t = 0;
+	int size = 0;
+public:
+	ParallelMix(ThreadPool& pool): pool(pool) {}
+	void add(Output<Sample>& input) {
+		inputs.push_back(&input);
+		buffers.emplace_back();
+		groups.clear();
+	}
+	Sample get(int t) override {
+		if (t - this->t >= 0 && t - this->t < size) {
+			return values[t - this->t];
+		}
+		Sample result;
+		for (Output<Sample>* input: inputs) {
+			result = result + input->get(t);
+		}
+		this->t = t;
+		size = 1;
+		all_silent = false;
+		values[0] = result;
+		return result;
+	}
+	void get_block(int t, Sample* buffer, int n) override {
+		get_block_silent(t, buffer, n);
+	}
+	// the mix is silent if all of its inputs are
+	bool get_block_silent(int t, Sample* buffer, int n) override {
+		if (t != this->t || n != size) {
+			if (groups.empty()) {
+				groups = group_independent(inputs);
+				silent.resize(inputs.size());
+			}
+			pool.run(groups.size(), [&](int group) {
+				for (std::size_t i: groups[group]) {
+					silent[i] = inputs[i]->get_block_silent(t, buffers[i].data(), n);
+				}
+			});
+			std::fill_n(values.data(), n, Sample());
+			all_silent = true;
+			for (std::size_t i = 0; i < inputs.size(); ++i) {
+				all_silent = all_silent && silent[i];
+				for (int j = 0; j < n; ++j) {
+					values[j] = values[j] + buffers[i][j];
+				}
+			}
+			this->t = t;
+			size = n;
+		}
+		std::copy_n(values.data(), n, buffer);
+		return all_silent;
+	}
+	void get_nodes(std::vector<const void*>& nodes) override {
+		if (std::find(nodes.begin(), nodes.end(), this) == nodes.end()) {
+			nodes.push_back(this);
+			for (Output<Sample>* input: inputs) {
+				input->get_nodes(nodes);
+			}
+		}
+	}
+	void serialize(StateArchive& archive) override {
+		if (archive.visit(this)) {
+			archive(values, all_silent, t, size);
+			for (Output<Sample>* input: inputs) {
+				input->serialize(archive);
+			}
+		}
+	}
+};
+
+// renders several outputs into one WAV file each and their sum into a master file in a single pass
+// outputs that share nodes are rendered by the same worker, so that no node is evaluated twice
+class StemRenderer {
+	static constexpr int CHUNK_SIZE = BLOCK_SIZE * 64;
+	ThreadPool& pool;
+	std::vector<Output<Sample>*> inputs;
+	std::vector<std::unique_ptr<WAVOutput>> files;
+	std::vector<std::vector<Sample>> buffers;
+	WAVOutput master;
+	WAVOutput::Format format;
+public:
+	StemRenderer(ThreadPool& pool, const char* master_file_name, WAVOutput::Format format = WAVOutput::S16): pool(pool), master(master_file_name, format), format(format) {}
+	void add(Output<Sample>& input, const char* file_name) {
+		inputs.push_back(&input);
+		files.emplace_back(new WAVOutput(file_name, format));
+		buffers.push_back(std::vector<Sample>(CHUNK_SIZE));
+	}
+	void run(int frames) {
+		DenormalGuard guard;
+		const std::vector<std::vector<std::size_t>> groups = group_independent(inputs);
+		std::vector<Sample> sum(CHUNK_SIZE);
+		for (int t = 1; t <= frames; t += CHUNK_SIZE) {
+			const int size = std::min(int(CHUNK_SIZE), frames - t + 1);
+			// workers only meet once per chunk
+			pool.run(groups.size(), [&](int group) {
+				for (int i = 0; i < size; i += BLOCK_SIZE) {
+					for (std::size_t input: groups[group]) {
+						inputs[input]->get_block(t + i, buffers[input].data() + i, std::min(BLOCK_SIZE, size - i));
+					}
+				}
+				for (std::size_t input: groups[group]) {
+					files[input]->append(buffers[input].data(), size);
+				}
+			});
+			std::fill_n(sum.data(), size, Sample());
+			for (const std::vector<Sample>& buffer: buffers) {
+				for (int i = 0; i < size; ++i) {
+					sum[i] = sum[i] + buffer[i];
+				}
+			}
+			master.append(sum.data(), size);
+		}
+		for (std::unique_ptr<WAVOutput>& file: files) {
+			file->close();
+		}
+		master.close();
+	}
+};
+
+// receives MIDI events from Source on its own thread and hands them to the audio thread
+// Source::receive(MIDIEvent&) should return false after a short timeout if no event arrived
+// every event is timestamped on arrival and played latency frames later, assuming the graph is
+// rendered at the sample rate (if rendering falls behind, the timeline is shifted to catch up)
+// events that arrive less than a frame after the previous one, like the notes of a chord that are read at
+// once, get its timestamp, so that they are played on the same frame
+// it outputs MIDIEvents, connect a Node2<OneEventPerFrame> to it for processors that take a MIDIEvent
+template <class Source, class Clock = std::chrono::steady_clock> class MIDIReceiver {
+	using TimePoint = typename Clock::time_point;
+	struct TimedEvent {
+		MIDIEvent event;
+		TimePoint time;
+	};
+	Source source;
+	SPSCQueue<TimedEvent, 1024> queue;
+	TimePoint previous; // the timestamp of the last event
+	std::atomic<bool> running;
+	std::thread thread;
+	TimePoint start;
+	long frame = 0; // the next frame
+	long sync = 0; // the frame at which start is checked next
+	int latency;
+	void receive() {
+		while (running) {
+			MIDIEvent event;
+			if (source.receive(event)) {
+				add(event, Clock::now());
+			}
+		}
+	}
+	long get_frame(TimePoint time) const {
+		return std::floor(std::chrono::duration<double>(time - start).count() / DT);
+	}
+public:
+	template <class... Arg> MIDIReceiver(Arg&&... arguments): source(std::forward<Arg>(arguments)...), running(true), thread([this]() {
+		receive();
+	}), latency(BLOCK_SIZE) {}
+	~MIDIReceiver() {
+		running = false;
+		thread.join();
+	}
+	void set_latency(int frames) {
+		latency = frames;
+	}
+	// timestamps an event that arrived at time, called by the receiving thread (or directly, with a Source that
+	// never receives anything, to play events at given times)
+	void add(MIDIEvent event, TimePoint time) {
+		if (time - previous >= std::chrono::duration<float>(DT)) {
+			previous = time;
+		}
+		queue.put({event, previous});
+	}
+	MIDIEvents process() {
+		MIDIEvents events;
+		process_block(&events, 1);
+		return events;
+	}
+	// takes the events due in the next n frames from the queue at once, each to the frame it is due on
+	// (events that are late go to the first frame)
+	void process_block(MIDIEvents* output, int n) {
+		if (frame >= sync) {
+			const TimePoint now = Clock::now();
+			if (frame == 0 || get_frame(now) > frame + latency) {
+				start = now - std::chrono::duration_cast<typename Clock::duration>(std::chrono::duration<double>(frame * DT));
+			}
+			sync = frame + BLOCK_SIZE;
+		}
+		std::fill_n(output, n, MIDIEvents());
+		TimedEvent event;
+		while (queue.peek(event)) {
+			const long due = get_frame(event.time) + latency;
+			if (due >= frame + n) {
+				break;
+			}
+			queue.take(event);
+			output[std::max(due - frame, 0L)].add(event.event);
+		}
+		frame += n;
+	}
+};
+
+// a stand-in MIDI source that plays a list of events, each after a delay in seconds
+class MIDIScript {
+	std::vector<std::pair<float, MIDIEvent>> events;
+	std::size_t position = 0;
+public:
+	MIDIScript(std::initializer_list<std::pair<float, MIDIEvent>> events): events(events) {}
+	bool receive(MIDIEvent& event) {
+		if (position == events.size()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::duration<float>(events[position].first));
+		event = events[position].second;
+		++position;
+		return true;
+	}
+};
+
+} // namespace modo